@@ -0,0 +1,69 @@
+/**
+ * @file include/base/aabb.h
+ *
+ * Kernel that tests a bounding box against a batch of others at once (and a
+ * swept test, for objects that move too far on a single step).
+ *
+ * The candidates are stored as a structure of arrays (one array for each
+ * edge), so they are loaded straight into vectors. If compiled with AVX2
+ * support (i.e., 'make AVX2=yes'), 8 candidates are tested at once; otherwise,
+ * SSE2 or NEON (whichever is available) test 4 candidates at once. There's
+ * also a scalar fallback.
+ */
+#ifndef __BASE_AABB_H__
+#define __BASE_AABB_H__
+
+/** Maximum number of candidates tested by a single call (i.e., the number of
+ * bits on the returned mask) */
+#define AABB_BATCH_LEN 32
+
+/** Bounding boxes, with each edge on its own array. Right and bottom are
+ * exclusive (i.e., position + dimension) */
+struct stAabbArrays {
+    int *pLeft;
+    int *pTop;
+    int *pRight;
+    int *pBottom;
+};
+typedef struct stAabbArrays aabbArrays;
+
+/**
+ * Test a bounding box against a batch of candidates
+ *
+ * @param  [ in]pBoxes The candidates
+ * @param  [ in]first  Index of the first candidate
+ * @param  [ in]count  Number of candidates (at most AABB_BATCH_LEN)
+ * @param  [ in]left   Left edge of the tested box
+ * @param  [ in]top    Top edge of the tested box
+ * @param  [ in]right  Right edge of the tested box (exclusive)
+ * @param  [ in]bottom Bottom edge of the tested box (exclusive)
+ * @return             Mask of overlapping candidates (where bit 'i' is set if
+ *                     the candidate 'first + i' overlaps the box)
+ */
+unsigned int overlapAabbBatch(const aabbArrays *pBoxes, int first, int count
+        , int left, int top, int right, int bottom);
+
+/**
+ * Sweep a bounding box along a displacement, against a static one. The boxes
+ * only collide if they overlap (rather than merely touch) at some point of
+ * the movement.
+ *
+ * @param  [out]pToi        Time of impact, as a fraction of the displacement
+ *                          (0 if the boxes already overlapped at the start)
+ * @param  [ in]x           Left edge of the swept box, at the start
+ * @param  [ in]y           Top edge of the swept box, at the start
+ * @param  [ in]width       Width of the swept box
+ * @param  [ in]height      Height of the swept box
+ * @param  [ in]dx          Horizontal displacement of the swept box
+ * @param  [ in]dy          Vertical displacement of the swept box
+ * @param  [ in]otherX      Left edge of the static box
+ * @param  [ in]otherY      Top edge of the static box
+ * @param  [ in]otherWidth  Width of the static box
+ * @param  [ in]otherHeight Height of the static box
+ * @return                  Whether the boxes collided
+ */
+int sweepAabb(double *pToi, int x, int y, int width, int height, int dx
+        , int dy, int otherX, int otherY, int otherWidth, int otherHeight);
+
+#endif /* __BASE_AABB_H__ */
+
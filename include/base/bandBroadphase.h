@@ -0,0 +1,126 @@
+/**
+ * @file include/base/bandBroadphase.h
+ *
+ * Broadphase that finds every overlapping pair at once (instead of one object
+ * at a time), splitting the world into horizontal bands that are swept on
+ * their own threads.
+ *
+ * Objects are added during the frame (without being collided) and all pairs
+ * are found by findBandPairs. Objects that straddle a few bands are swept on
+ * each of them, but a pair is only reported by the band where their overlap
+ * starts. The pairs are always reported on the same order (sorted by their
+ * ids), regardless of the number of threads.
+ */
+#ifndef __BASE_BANDBROADPHASE_H__
+#define __BASE_BANDBROADPHASE_H__
+
+#include <base/error.h>
+
+#include <GFraMe/gfmObject.h>
+
+/** Minimum number of objects before the bands are split across threads */
+#define BAND_THREAD_MIN_OBJECTS 256
+/** Maximum number of bands (and of threads) */
+#define BAND_MAX_THREADS        8
+
+/** An object added to the broadphase */
+struct stBandObject {
+    /** Id given by the caller */
+    int id;
+    int x;
+    int y;
+    int width;
+    int height;
+    /** Collision layer of the object */
+    unsigned int layer;
+    /** Collision layers that may interact with the object */
+    unsigned int mask;
+};
+typedef struct stBandObject bandObject;
+
+/** A pair of overlapping objects (where id1 < id2) */
+struct stBandPair {
+    int id1;
+    int id2;
+};
+typedef struct stBandPair bandPair;
+
+/** Objects touching a band and the pairs that it found */
+struct stBand {
+    /** Copy of every object touching the band, sorted by their horizontal
+     * position */
+    bandObject *pObjects;
+    int numObjects;
+    int maxObjects;
+    /** Edges of every object on pObjects (one array after the other), so
+     * they may be tested by overlapAabbBatch */
+    int *pBounds;
+    int maxBounds;
+    bandPair *pPairs;
+    int numPairs;
+    int maxPairs;
+    /** Vertical range of the band ([top, bottom)) */
+    int top;
+    int bottom;
+    /** Error found while sweeping the band */
+    err erv;
+};
+typedef struct stBand band;
+
+struct stBandBroadphase {
+    /** Every object added since the last reset */
+    bandObject *pObjects;
+    int numObjects;
+    int maxObjects;
+    /** Every overlapping pair, as found by findBandPairs */
+    bandPair *pPairs;
+    int numPairs;
+    int maxPairs;
+    band bands[BAND_MAX_THREADS];
+};
+typedef struct stBandBroadphase bandBroadphase;
+
+/**
+ * Initialize an (empty) band broadphase
+ *
+ * @param  [ in]pBP The broadphase
+ */
+err initBandBroadphase(bandBroadphase *pBP);
+
+/**
+ * Release all memory used by a band broadphase
+ *
+ * @param  [ in]pBP The broadphase
+ */
+void freeBandBroadphase(bandBroadphase *pBP);
+
+/**
+ * Remove every object (and pair) from a band broadphase, but keep its memory
+ *
+ * @param  [ in]pBP The broadphase
+ */
+void resetBandBroadphase(bandBroadphase *pBP);
+
+/**
+ * Add an object to a band broadphase. Its pairs are only found by
+ * findBandPairs.
+ *
+ * @param  [ in]pBP     The broadphase
+ * @param  [ in]pObject The object
+ * @param  [ in]id      Id reported for the object, on overlaps
+ * @param  [ in]layer   Collision layer of the object
+ * @param  [ in]mask    Collision layers that may interact with the object
+ */
+err addBandObject(bandBroadphase *pBP, gfmObject *pObject, int id
+        , unsigned int layer, unsigned int mask);
+
+/**
+ * Find every pair of overlapping objects that may interact. The pairs are
+ * stored on pBP->pPairs, sorted by their ids.
+ *
+ * @param  [ in]pBP The broadphase
+ */
+err findBandPairs(bandBroadphase *pBP);
+
+#endif /* __BASE_BANDBROADPHASE_H__ */
+
@@ -13,6 +13,15 @@
  *  --fullscreen | -f: Init game in fullscreen mode
  *  --list | -l: List all available resolution
  *  --save | -s: *TODO* Save the current configuration
+ *  --broadphase | -B: Set the dynamic broadphase {quadtree, hash,
+ *                     bands, incremental}
+ *  --batch-collision | -c: Gather every collision pair before resolving them
+ *  --headless | -H: Run the simulation as fast as possible, without drawing
+ *  --frames | -n: Set how many frames are run on headless mode
+ *  --threaded | -t: Run the simulation on its own thread
+ *  --profile | -p: Record a Chrome trace of every frame into a file
+ *  --record | -R: Record the input of every step into a file
+ *  --replay | -P: Replay the input recorded into a file (and exit after it)
  *  --help | -h: Print usage
  */
 #ifndef __CMD_PARSE_H__
@@ -4,17 +4,122 @@
 #ifndef __BASE_COLLISION_H__
 #define __BASE_COLLISION_H__
 
+#include <base/bandBroadphase.h>
 #include <base/error.h>
+#include <base/incrementalHash.h>
+#include <base/spatialHash.h>
 
+#include <GFraMe/gfmObject.h>
 #include <GFraMe/gfmQuadtree.h>
+#include <GFraMe/gfmSprite.h>
+
+/** Maximum depth of the quadtrees */
+#define QT_MAX_DEPTH 8
+/** Maximum number of objects on a quadtree's node before it's subdivided */
+#define QT_MAX_NODES 16
+/** Dimensions of each tile on the static world, in bits (i.e., 8x8 pixels) */
+#define STATIC_TILE_BITS 3
+
+/** Structures that may detect collision between dynamic objects. BP_BANDS
+ * only finds pairs on resolveCollision, so it requires the batch mode.
+ * BP_INCREMENTAL keeps objects between frames (see sleepObject) */
+enum enBroadphase {
+    BP_QUADTREE = 0,
+    BP_SPATIALHASH,
+    BP_BANDS,
+    BP_INCREMENTAL,
+    BP_MAX
+};
+typedef enum enBroadphase broadphase;
+
+/**
+ * Every object added to the dynamic broadphase on the current frame, already
+ * resolved into its sprite, child and type. Objects are identified by their
+ * index on these arrays (which is what the spatial hash reports).
+ */
+struct stCollisionNodeCache {
+    gfmObject **ppObjects;
+    gfmSprite **ppSprites;
+    void **ppChildren;
+    int *pTypes;
+    /** Proxy of each object on collision.proxies (or -1, if it wasn't
+     * swept) */
+    int *pProxies;
+    /** Number of objects added on the current frame */
+    int numNodes;
+    /** Capacity of the arrays */
+    int maxNodes;
+    /** Object being collided by collideObject (or -1) */
+    int current;
+};
+typedef struct stCollisionNodeCache collisionNodeCache;
+
+/**
+ * Objects added to the broadphases in place of swept objects (see
+ * collideSweptObject), covering their whole movement. Pairs reported for a
+ * proxy are tested against the movement before being handled. Proxies are
+ * kept (and reused) between frames.
+ */
+struct stCollisionProxies {
+    gfmObject **ppObjects;
+    /** Index of the swept object on the node cache */
+    int *pIds;
+    /** Position of the swept object at the start of the step */
+    int *pFromX;
+    int *pFromY;
+    /** Number of proxies used on the current frame */
+    int numProxies;
+    /** Number of proxies allocated */
+    int maxProxies;
+};
+typedef struct stCollisionProxies collisionProxies;
 
 struct stCollisionCtx {
     /** Quadtree's root */
     gfmQuadtreeRoot *pQt;
-    /** Static quadtree's root */
-    gfmQuadtreeRoot *pStaticQt;
+    /** Tiles of the static world, row by row, queried directly by
+     * collideObject (or 0, if there's no static world) */
+    const int *pTiles;
+    /** Width of the static world, in tiles */
+    int widthInTiles;
+    /** Height of the static world, in tiles */
+    int heightInTiles;
+    /** Type of each tile on pTiles (0 if it doesn't collide), indexed by the
+     * tile */
+    const int *pTileTypes;
+    /** Number of entries on pTileTypes */
+    int numTileTypes;
+    /** Spatial hash (used instead of pQt, depending on broadphase) */
+    spatialHash hash;
+    /** Multi-threaded broadphase (used instead of pQt, depending on
+     * broadphase) */
+    bandBroadphase bands;
+    /** Persistent spatial hash (used instead of pQt, depending on
+     * broadphase) */
+    incrementalHash incremental;
+    /** Broadphase used by collideObject. Must only be modified right before
+     * resetCollision */
+    broadphase broadphase;
+    /** Objects added to the dynamic broadphase. Cleared by resetCollision */
+    collisionNodeCache nodes;
+    /** Stand-ins for swept objects (reused after resetCollision) */
+    collisionProxies proxies;
+    /** Whether overlapping pairs are only gathered (and later resolved by
+     * resolveCollision), instead of handled as soon as they are found */
+    int batch;
     /** Whether pending collisions (for the current object) should be skipped */
     int skip;
+    /** Collision layers of every object added to the dynamic broadphase (by
+     * collideObject) */
+    unsigned int layers;
+    /** Collision layers of every object on the static world */
+    unsigned int staticLayers;
+    /** Whether the time spent on collideObject and collideSweptObject is
+     * measured into collideTime (as that adds some overhead) */
+    int isTimed;
+    /** Time spent colliding objects since the last resetCollision, in
+     * seconds (only measured if isTimed) */
+    double collideTime;
 #if defined(DEBUG)
     /** Quadtree's visibility */
     int visibility;
@@ -31,6 +136,19 @@ err setupCollision();
 /** Release all memory used by the collision context */
 void cleanCollision();
 
+/**
+ * Remove every object from the dynamic broadphase, so it's ready for a new
+ * frame. The incremental hash only removes the awake objects that weren't
+ * collided on the last frame. The area is ignored by every broadphase but
+ * the quadtree (as the others are unbounded).
+ *
+ * @param  [ in]x      Left position of the quadtree
+ * @param  [ in]y      Top position of the quadtree
+ * @param  [ in]width  Width of the quadtree
+ * @param  [ in]height Height of the quadtree
+ */
+err resetCollision(int x, int y, int width, int height);
+
 /**
  * Continue handling collision.
  * 
@@ -38,10 +156,109 @@ void cleanCollision();
  * src/collision.c (instead of src/base/collision.c). This decision was made
  * because this function shall be modified for each game.
  *
- * @param  [ in]pQt The current quadtree
+ * @param  [ in]pQt The current quadtree (or 0, for collision.hash or
+ *                  collision.incremental)
  */
 err doCollide(gfmQuadtreeRoot *pQt);
 
+/**
+ * Generate the table used by doCollide to dispatch each pair of types into its
+ * handler. Declared on src/collision.c and called by setupCollision.
+ */
+err initCollisionDispatch();
+
+/**
+ * Retrieve the collision layer of a type (i.e., a bit that identifies it on
+ * the collision masks). Declared on src/collision.c.
+ *
+ * @param  [ in]type The type
+ */
+unsigned int getCollisionLayer(int type);
+
+/**
+ * Retrieve the collision layers that may interact with a type. Declared on
+ * src/collision.c.
+ *
+ * @param  [ in]type The type
+ */
+unsigned int getCollisionMask(int type);
+
+/**
+ * Collide an object against the static world and the dynamic broadphase and
+ * add it to the latter. Pairs that never interact (i.e., handled by
+ * ignoreCollision) are pruned before reaching the broadphase. Declared on
+ * src/collision.c.
+ *
+ * @param  [ in]pObject The object
+ */
+err collideObject(gfmObject *pObject);
+
+/**
+ * Collide an object that moved from (fromX, fromY) to its current position
+ * on this step, so it's stopped by anything along the way (instead of going
+ * through it). The handlers receive the time of impact of each pair, and the
+ * static world is reported in the order it was hit. Other objects are
+ * expected to move along a line as well (if swept) or to stand still.
+ * Declared on src/collision.c.
+ *
+ * @param  [ in]pObject The object (at its position at the end of the step)
+ * @param  [ in]fromX   Horizontal position of the object at the start
+ * @param  [ in]fromY   Vertical position of the object at the start
+ */
+err collideSweptObject(gfmObject *pObject, int fromX, int fromY);
+
+/**
+ * Put an object to sleep, so it doesn't have to be collided (nor even moved
+ * within the broadphase) anymore. Awake objects are still collided against
+ * it. Only used by BP_INCREMENTAL. Sleeping objects are dropped whenever the
+ * state or the room is switched, so they must not outlive either. Declared
+ * on src/collision.c.
+ *
+ * @param  [ in]pObject The object
+ */
+err sleepObject(gfmObject *pObject);
+
+/**
+ * Wake a sleeping object up. It must be collided on every frame (or be put
+ * to sleep again), or it's removed from the broadphase. Only used by
+ * BP_INCREMENTAL. Declared on src/collision.c.
+ *
+ * @param  [ in]pObject The object
+ */
+err wakeObject(gfmObject *pObject);
+
+/**
+ * Remove an object (e.g., a sleeping one that was destroyed) from the
+ * broadphase. Only used by BP_INCREMENTAL. Declared on src/collision.c.
+ *
+ * @param  [ in]pObject The object
+ */
+void removeObject(gfmObject *pObject);
+
+/**
+ * Resolve every pair gathered (on batch mode) since the last call. If using
+ * BP_BANDS, this is also when pairs of dynamic objects are found. Pairs are
+ * sorted by their types (and then by the order they were found) and each
+ * handler is called for all of its pairs at once. skipCollision has no effect
+ * on gathered pairs. Must be called before resetCollision. Declared on
+ * src/collision.c.
+ */
+err resolveCollision();
+
+/**
+ * Release the buffer of gathered pairs (and of swept tiles). Declared on
+ * src/collision.c and called by cleanCollision.
+ */
+void cleanCollisionPairs();
+
+#if defined(DEBUG)
+/**
+ * Print how many times each pair of types collided. Declared on
+ * src/collision.c and called by cleanCollision.
+ */
+void printCollisionStats();
+#endif
+
 /** Skip any pending collision for the current object */
 #define skipCollision() do { collision.skip = 1; } while (0)
 
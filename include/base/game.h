@@ -29,6 +29,12 @@ struct stGameCtx {
     state currentState;
     /** State that will start being played on the next frame */
     state nextState;
+    /** Number of frames simulated (as fast as possible, without drawing)
+     * before exiting. 0 if running normally */
+    int headlessFrames;
+    /** Whether the simulation runs on its own thread, publishing snapshots
+     * for the (main) rendering thread. Ignored on Windows */
+    int threaded;
 #if defined(DEBUG)
     /** Running state for the debug build. Allows the game to be executed
      * step-by-step. */
@@ -0,0 +1,203 @@
+/**
+ * @file include/base/incrementalHash.h
+ *
+ * Broadphase that keeps objects between frames, only relocating the ones
+ * that moved.
+ *
+ * Just like the spatial hash, objects are bucketed into fixed cells, but they
+ * are never cleared. Each object remembers its bounds and its cells, so an
+ * object that didn't move (or that only moved within its cells) is never
+ * re-inserted. Objects are identified by their gfmObject.
+ *
+ * Objects may be put to sleep: sleeping objects are never collided (nor
+ * relocated), but they are still reported when an awake object overlaps them.
+ * Awake objects that weren't collided on a frame are removed when the next
+ * frame begins, so the per-frame cost only depends on the awake objects.
+ */
+#ifndef __BASE_INCREMENTALHASH_H__
+#define __BASE_INCREMENTALHASH_H__
+
+#include <base/error.h>
+
+#include <GFraMe/gfmObject.h>
+
+/** Dimensions of each cell, in bits (i.e., 16x16 pixels, or 2x2 tiles) */
+#define INCREMENTALHASH_CELL_BITS 4
+/** Number of buckets. Must be a power of 2 */
+#define INCREMENTALHASH_BUCKETS   1024
+
+/** An object kept on the hash */
+struct stIncrementalObject {
+    gfmObject *pObject;
+    /** Id given on the last collision (or -1, if not collided on the current
+     * frame) */
+    int id;
+    /** Bounds when the object was last inserted */
+    int x;
+    int y;
+    int width;
+    int height;
+    /** Collision layer of the object */
+    unsigned int layer;
+    /** Collision layers that may interact with the object */
+    unsigned int mask;
+    /** First of the object's cell nodes (or -1) */
+    int firstNode;
+    /** Position on the list of awake objects (or -1, if asleep) */
+    int awakeIndex;
+    /** Last frame in which the object was collided */
+    unsigned int frame;
+    /** Last query that checked this object (so it's only reported once) */
+    unsigned int lastQuery;
+};
+typedef struct stIncrementalObject incrementalObject;
+
+/** Entry of an object on one of its cells */
+struct stIncrementalNode {
+    /** Index of the object on pObjects (or of the next free node) */
+    int object;
+    int cellX;
+    int cellY;
+    /** Neighbouring nodes on the bucket (or -1) */
+    int prev;
+    int next;
+    /** Next node of the same object (or -1) */
+    int nextOfObject;
+};
+typedef struct stIncrementalNode incrementalNode;
+
+struct stIncrementalHash {
+    /** Every object kept on the hash (removed ones are linked on freeObject,
+     * through their id) */
+    incrementalObject *pObjects;
+    int numObjects;
+    int maxObjects;
+    int freeObject;
+    /** Every cell occupied by an object (free ones are linked on freeNode) */
+    incrementalNode *pNodes;
+    int numNodes;
+    int maxNodes;
+    int freeNode;
+    /** First node on each bucket (or -1) */
+    int pBuckets[INCREMENTALHASH_BUCKETS];
+    /** Open addressing map from gfmObject to its index on pObjects (or -1) */
+    int *pMap;
+    int mapLen;
+    int mapUsed;
+    /** Every awake object */
+    int *pAwake;
+    int numAwake;
+    int maxAwake;
+    /** Objects overlapping the one collided last */
+    int *pOverlaps;
+    int numOverlaps;
+    int maxOverlaps;
+    /** Overlap currently being reported */
+    int curOverlap;
+    /** Object collided last */
+    int curObject;
+    /** Incremented on every frame */
+    unsigned int frame;
+    /** Incremented on every query */
+    unsigned int queryCount;
+};
+typedef struct stIncrementalHash incrementalHash;
+
+/**
+ * Initialize an (empty) incremental hash
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+err initIncrementalHash(incrementalHash *pHash);
+
+/**
+ * Release all memory used by an incremental hash
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+void freeIncrementalHash(incrementalHash *pHash);
+
+/**
+ * Remove every object (awake or asleep) from an incremental hash, but keep
+ * its memory
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+void clearIncrementalHash(incrementalHash *pHash);
+
+/**
+ * Start a new frame, removing every awake object that wasn't collided since
+ * the last call
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+void beginIncrementalFrame(incrementalHash *pHash);
+
+/**
+ * Collide an (awake) object against every other on the hash. The object is
+ * added if it wasn't on the hash and relocated if it moved (or woken up, if
+ * asleep). Only objects already collided on this frame and sleeping objects
+ * are reported. The overlapping pairs are retrieved with
+ * getIncrementalOverlap and continueIncrementalHash.
+ *
+ * @param  [out]pDidOverlap Whether the object overlapped anything
+ * @param  [ in]pHash       The incremental hash
+ * @param  [ in]pObject     The object
+ * @param  [ in]id          Id reported for the object, on overlaps
+ * @param  [ in]layer       Collision layer of the object
+ * @param  [ in]mask        Collision layers that may interact with the object
+ */
+err collideIncrementalHash(int *pDidOverlap, incrementalHash *pHash
+        , gfmObject *pObject, int id, unsigned int layer, unsigned int mask);
+
+/**
+ * Retrieve the current overlapping pair
+ *
+ * @param  [out]pId1      Id of the object collided last
+ * @param  [out]pId2      Id of the object overlapping it (or -1, if it's
+ *                        asleep)
+ * @param  [out]ppObject2 The object overlapping it
+ * @param  [ in]pHash     The incremental hash
+ */
+void getIncrementalOverlap(int *pId1, int *pId2, gfmObject **ppObject2
+        , incrementalHash *pHash);
+
+/**
+ * Move to the next overlapping pair
+ *
+ * @param  [ in]pHash The incremental hash
+ * @return            Whether there's another pair
+ */
+int continueIncrementalHash(incrementalHash *pHash);
+
+/**
+ * Put an object to sleep (adding it, if it wasn't on the hash). Its bounds
+ * are updated one last time, so it must be woken up before moving again.
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ * @param  [ in]layer   Collision layer of the object
+ * @param  [ in]mask    Collision layers that may interact with the object
+ */
+err sleepIncrementalObject(incrementalHash *pHash, gfmObject *pObject
+        , unsigned int layer, unsigned int mask);
+
+/**
+ * Wake up a sleeping object. It must be collided on every frame, from now
+ * on, or it's removed.
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ */
+err wakeIncrementalObject(incrementalHash *pHash, gfmObject *pObject);
+
+/**
+ * Remove an object (awake or asleep) from the hash
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ */
+void removeIncrementalObject(incrementalHash *pHash, gfmObject *pObject);
+
+#endif /* __BASE_INCREMENTALHASH_H__ */
+
@@ -38,22 +38,39 @@ extern inputCtx input;
 /**
  * Handle every input that require an immediate action (i.e, those that are more
  * like flags, instead of being interpreted during the game loop).
+ *
+ * @param  [ in]pInput The buttons' states
  */
-void handleInput();
+void handleInput(const inputCtx *pInput);
 
 #if defined(DEBUG)
 /**
  * Handle the debug controls of the game's simulation. These allow the update
  * loop to be paused/resumed or even stepped.
+ *
+ * @param  [ in]pInput The buttons' states
  */
-void handleDebugInput();
+void handleDebugInput(const inputCtx *pInput);
 #endif
 
-/** Retrieve the state of every button */
-err updateInput();
+/**
+ * Retrieve the state of every button. Other than the global input, the
+ * buttons may be read into a copy of it (e.g., to be handed to another
+ * thread). When replaying, the states are read from the replay, instead (and
+ * when recording, they are also written to it).
+ *
+ * @param  [ in]pInput The buttons (which must have been initialized on the
+ *                     global input)
+ */
+err updateInput(inputCtx *pInput);
 
-/** Forcefully update every debug button */
-err updateDebugInput();
+/**
+ * Forcefully update every debug button
+ *
+ * @param  [ in]pInput The buttons (which must have been initialized on the
+ *                     global input)
+ */
+err updateDebugInput(inputCtx *pInput);
 
 /** Initialize every button with their default mapping */
 err initInput();
@@ -0,0 +1,96 @@
+/**
+ * @file include/base/profiler.h
+ *
+ * Scoped timers around each phase of a frame, exported as a Chrome trace
+ * (i.e., loadable on chrome://tracing or on Perfetto).
+ *
+ * Zones (listed on conf/profiler_list.h) are timed with PROFILE_BEGIN and
+ * PROFILE_END, on the same block. Each thread records its samples into its
+ * own ring buffer (so recording never locks), keeping only the latest
+ * PROFILER_RING_LEN ones. The trace is written by dumpProfiler, which may be
+ * called at any time, and when the profiler is cleaned.
+ *
+ * The macros are only compiled in when ENABLE_PROFILER is defined (i.e., when
+ * building with PROFILER=yes, the default). Even then, samples are only taken
+ * after initProfiler is called, so a disabled profiler costs a single test.
+ * Recording relies on GCC/Clang extensions (__thread and the __atomic
+ * builtins), so other compilers must build with PROFILER=no.
+ */
+#ifndef __BASE_PROFILER_H__
+#define __BASE_PROFILER_H__
+
+#include <base/error.h>
+#include <conf/profiler_list.h>
+
+#if defined(ENABLE_PROFILER) && !defined(__GNUC__)
+#  error "The profiler requires GCC or Clang. Build with PROFILER=no instead"
+#endif
+
+/** Number of samples kept for each thread. Must be a power of 2 */
+#define PROFILER_RING_LEN   (1 << 16)
+/** Maximum number of threads that may record samples */
+#define PROFILER_MAX_THREADS 8
+
+/** Every zone (see conf/profiler_list.h) */
+enum enProfilerZone {
+#define X(name, ...) PZ_##name,
+    PROFILER_ZONE_LIST
+#undef X
+    PZ_MAX
+};
+typedef enum enProfilerZone profilerZone;
+
+/** Whether samples are being taken (declared on src/base/profiler.c) */
+extern int isProfiling;
+
+/** Retrieve the current time, in seconds (from an arbitrary point) */
+double getProfilerTime();
+
+/**
+ * Start taking samples
+ *
+ * @param  [ in]pPath Where the trace is written (must be kept valid until the
+ *                    profiler is cleaned)
+ */
+err initProfiler(const char *pPath);
+
+/** Write the trace (if profiling) and release every ring buffer */
+void cleanProfiler();
+
+/**
+ * Name the calling thread on the trace. Threads that record samples without
+ * calling this are simply numbered.
+ *
+ * @param  [ in]pName The thread's name (must be a static string)
+ */
+void setProfilerThread(const char *pName);
+
+/**
+ * Record a sample for the calling thread, ending now
+ *
+ * @param  [ in]zone  The zone
+ * @param  [ in]start When the zone started (from getProfilerTime)
+ */
+void addProfilerSample(profilerZone zone, double start);
+
+/** Write every sample kept so far into the trace (overwriting it) */
+err dumpProfiler();
+
+#if defined(ENABLE_PROFILER)
+/** Start timing a zone */
+#  define PROFILE_BEGIN(zone) \
+     double _profile_##zone = (isProfiling ? getProfilerTime() : 0.0)
+/** Stop timing a zone (started on the same block) */
+#  define PROFILE_END(zone) \
+     do { \
+         if (isProfiling) { \
+             addProfilerSample(PZ_##zone, _profile_##zone); \
+         } \
+     } while (0)
+#else
+#  define PROFILE_BEGIN(zone) do {} while (0)
+#  define PROFILE_END(zone) do {} while (0)
+#endif
+
+#endif /* __BASE_PROFILER_H__ */
+
@@ -0,0 +1,93 @@
+/**
+ * @file include/base/replay.h
+ *
+ * Record the state of every button on each step into a file and replay it
+ * back, in place of the real devices.
+ *
+ * The file starts with a replayFileHeader, followed by one record for each
+ * step where a button changed and one for each run of steps without changes.
+ * Every record starts with a variable length integer (7 bits per byte, least
+ * significant first):
+ *  - If its lowest bit is clear, the remaining bits are the number of steps
+ *    repeating the previous states
+ *  - Otherwise, the remaining bits are a mask of the buttons that changed on
+ *    this step, each followed by its state (a byte) and its number of
+ *    consecutive presses (a variable length integer)
+ *
+ * Since nothing else in the simulation is random (and the level always
+ * starts on its first room, in its default orientation), replaying a file
+ * with the same update rate reproduces the recorded steps exactly.
+ */
+#ifndef __BASE_REPLAY_H__
+#define __BASE_REPLAY_H__
+
+#include <base/error.h>
+#include <base/input.h>
+
+#include <stdint.h>
+
+/** "RPLY", as read from a little endian integer */
+#define REPLAY_FILE_MAGIC   0x594c5052
+/** Current version of the format. Must be increased on any change. */
+#define REPLAY_FILE_VERSION 1
+
+/** Header of every replay */
+struct stReplayFileHeader {
+    /** Must be REPLAY_FILE_MAGIC */
+    uint32_t magic;
+    /** Must be REPLAY_FILE_VERSION */
+    uint32_t version;
+    /** Number of (non-debug) buttons on each step */
+    int32_t numButtons;
+    /** Update rate (i.e., steps per second) */
+    int32_t fps;
+};
+typedef struct stReplayFileHeader replayFileHeader;
+
+/**
+ * Start recording every step read through updateInput
+ *
+ * @param  [ in]pPath The replay
+ * @param  [ in]fps   Update rate of the game
+ */
+err initRecording(const char *pPath, int fps);
+
+/**
+ * Start replaying a file. Afterward, updateInput reads from it, instead of
+ * the devices.
+ *
+ * @param  [out]pFps  Update rate of the recorded game (which should be used)
+ * @param  [ in]pPath The replay
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE
+ */
+err initReplay(int *pFps, const char *pPath);
+
+/** Finish writing the recording (if any) and close the file */
+void cleanReplay();
+
+/** Whether a file is being replayed */
+int isReplaying();
+
+/** Whether a file is being recorded */
+int isRecording();
+
+/** Whether the replay has no more steps */
+int isReplayDone();
+
+/**
+ * Append the state of every button to the recording (if recording)
+ *
+ * @param  [ in]pInput The buttons
+ */
+err recordInput(const inputCtx *pInput);
+
+/**
+ * Retrieve the state of every button on the next replayed step. Once the
+ * replay is done, every button is kept released.
+ *
+ * @param  [ in]pInput The buttons
+ */
+err replayInput(inputCtx *pInput);
+
+#endif /* __BASE_REPLAY_H__ */
+
@@ -25,6 +25,11 @@
  * startup.
  * Also, input must be manually set up later.
  *
+ * On headless mode, neither audio nor the FPS counter are set up. A window is
+ * still required (as textures and the tilemaps depend on it), but it's kept
+ * as small as possible and, on Linux, created on SDL's dummy video driver (so
+ * no display is required).
+ *
  * @param  [ in]argc    Number of arguments received
  * @param  [ in]argv    List of arguments received
  * @return
@@ -0,0 +1,70 @@
+/**
+ * @file include/base/snapshot.h
+ *
+ * Triple buffer of the drawable state, used when the simulation runs on its
+ * own thread.
+ *
+ * The simulation fills the back buffer (retrieved with getSnapshotBuffer) and
+ * publishes it after every step. The renderer then acquires the latest
+ * published snapshot, which stays untouched until it's acquired again. Since
+ * there are three buffers, neither side ever waits for the other (other than
+ * for swapping an index).
+ */
+#ifndef __BASE_SNAPSHOT_H__
+#define __BASE_SNAPSHOT_H__
+
+#include <base/error.h>
+#include <conf/state.h>
+
+/** Drawable state of a single simulation step */
+struct stSnapshot {
+    /** Step that generated the snapshot (0 if nothing was published yet) */
+    unsigned int frame;
+    /** State being played */
+    state currentState;
+    /** Tiles of the current room, on its current orientation */
+    int *pTiles;
+    int widthInTiles;
+    int heightInTiles;
+    /** Capacity of pTiles */
+    int maxTiles;
+    /** Changes whenever the tiles do (e.g., the version from getLevelData),
+     * so they are only copied and drawn again when needed */
+    unsigned int tilesVersion;
+};
+typedef struct stSnapshot snapshot;
+
+/** Initialize (empty) every snapshot */
+err initSnapshots();
+
+/** Release every snapshot */
+void cleanSnapshots();
+
+/**
+ * Retrieve the snapshot being written. Must only be called from the
+ * simulation.
+ */
+snapshot* getSnapshotBuffer();
+
+/** Publish the snapshot being written, replacing the previous one */
+void publishSnapshot();
+
+/**
+ * Retrieve the latest published snapshot. Must only be called from the
+ * renderer and it's only valid until the next call.
+ */
+const snapshot* getLatestSnapshot();
+
+/**
+ * Copy a tilemap into a snapshot (expanding it as necessary)
+ *
+ * @param  [ in]pSnapshot The snapshot
+ * @param  [ in]pTiles    The tiles
+ * @param  [ in]width     The width in tiles
+ * @param  [ in]height    The height in tiles
+ */
+err setSnapshotTiles(snapshot *pSnapshot, const int *pTiles, int width
+        , int height);
+
+#endif /* __BASE_SNAPSHOT_H__ */
+
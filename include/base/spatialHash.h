@@ -0,0 +1,144 @@
+/**
+ * @file include/base/spatialHash.h
+ *
+ * Broadphase that buckets objects into fixed cells (aligned to the tile grid),
+ * as an alternative to GFraMe's quadtree.
+ *
+ * It's used just like a (non-static) quadtree: it's reset every frame, each
+ * object is collided against everything already added (and then added itself)
+ * and every overlapping pair is retrieved one at a time, until there's none
+ * left. Differently from the quadtree, pairs are reported as the ids given
+ * to the objects when they were added, and pairs that may not interact (as
+ * neither object's mask has the other's layer) are never reported.
+ */
+#ifndef __BASE_SPATIALHASH_H__
+#define __BASE_SPATIALHASH_H__
+
+#include <base/error.h>
+
+#include <GFraMe/gfmObject.h>
+
+/** Dimensions of each cell, in bits (i.e., 16x16 pixels, or 2x2 tiles) */
+#define SPATIALHASH_CELL_BITS 4
+/** Number of buckets. Must be a power of 2 */
+#define SPATIALHASH_BUCKETS 1024
+
+/** An object added to the hash */
+struct stSpatialHashObject {
+    /** Id given by the caller */
+    int id;
+    int x;
+    int y;
+    int width;
+    int height;
+    /** Collision layer of the object */
+    unsigned int layer;
+    /** Collision layers that may interact with the object */
+    unsigned int mask;
+    /** Last query that checked this object (so it's only reported once) */
+    unsigned int lastQuery;
+};
+typedef struct stSpatialHashObject spatialHashObject;
+
+/** Entry of an object on one of its cells */
+struct stSpatialHashNode {
+    /** Index of the object on pObjects */
+    int object;
+    int cellX;
+    int cellY;
+    /** Next node on the bucket (or -1) */
+    int next;
+};
+typedef struct stSpatialHashNode spatialHashNode;
+
+struct stSpatialHash {
+    /** Every object added since the last reset */
+    spatialHashObject *pObjects;
+    int numObjects;
+    int maxObjects;
+    /** Every cell occupied by an object */
+    spatialHashNode *pNodes;
+    int numNodes;
+    int maxNodes;
+    /** First node on each bucket (or -1) */
+    int pBuckets[SPATIALHASH_BUCKETS];
+    /** Objects overlapping the one collided last */
+    int *pOverlaps;
+    int numOverlaps;
+    int maxOverlaps;
+    /** Overlap currently being reported */
+    int curOverlap;
+    /** Object collided last */
+    int curObject;
+    /** Incremented on every query */
+    unsigned int queryCount;
+};
+typedef struct stSpatialHash spatialHash;
+
+/**
+ * Initialize an (empty) spatial hash
+ *
+ * @param  [ in]pHash The spatial hash
+ */
+err initSpatialHash(spatialHash *pHash);
+
+/**
+ * Release all memory used by a spatial hash
+ *
+ * @param  [ in]pHash The spatial hash
+ */
+void freeSpatialHash(spatialHash *pHash);
+
+/**
+ * Remove every object from a spatial hash (but keep its memory)
+ *
+ * @param  [ in]pHash The spatial hash
+ */
+void resetSpatialHash(spatialHash *pHash);
+
+/**
+ * Add an object to a spatial hash, without colliding it
+ *
+ * @param  [ in]pHash   The spatial hash
+ * @param  [ in]pObject The object
+ * @param  [ in]id      Id reported for the object, on overlaps
+ * @param  [ in]layer   Collision layer of the object
+ * @param  [ in]mask    Collision layers that may interact with the object
+ */
+err populateSpatialHash(spatialHash *pHash, gfmObject *pObject, int id
+        , unsigned int layer, unsigned int mask);
+
+/**
+ * Collide an object against every other on a spatial hash and then add it.
+ * The overlapping pairs are retrieved with getSpatialHashOverlap and
+ * continueSpatialHash.
+ *
+ * @param  [out]pDidOverlap Whether the object overlapped anything
+ * @param  [ in]pHash       The spatial hash
+ * @param  [ in]pObject     The object
+ * @param  [ in]id          Id reported for the object, on overlaps
+ * @param  [ in]layer       Collision layer of the object
+ * @param  [ in]mask        Collision layers that may interact with the object
+ */
+err collideSpatialHash(int *pDidOverlap, spatialHash *pHash
+        , gfmObject *pObject, int id, unsigned int layer, unsigned int mask);
+
+/**
+ * Retrieve the current overlapping pair
+ *
+ * @param  [out]pId1  Id of the object collided last
+ * @param  [out]pId2  Id of the object overlapping it
+ * @param  [ in]pHash The spatial hash
+ */
+void getSpatialHashOverlap(int *pId1, int *pId2, spatialHash *pHash);
+
+/**
+ * Move to the next overlapping pair
+ *
+ * @param  [ in]pHash The spatial hash
+ * @return            Whether there's another pair
+ */
+int continueSpatialHash(spatialHash *pHash);
+
+#endif /* __BASE_SPATIALHASH_H__ */
+
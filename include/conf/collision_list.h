@@ -0,0 +1,35 @@
+/**
+ * @file include/conf/collision_list.h
+ *
+ * Lists of types that may collide and of how each pair of types is handled.
+ *
+ * When defining the 'X macro' for COLLIDABLE_LIST, the first parameter is the
+ * name of the type within the collision module (which becomes CI_<name>) and
+ * the second is its in-game type (as defined on conf/type.h).
+ *
+ * When defining the 'X macro' for COLLISION_LIST, the first two parameters
+ * are names from COLLIDABLE_LIST and the last is the function that handles
+ * their collision (declared on src/collision.c). The handler always receives
+ * the objects in the listed order, regardless of the order reported by the
+ * quadtree. Pairs that aren't listed are reported as unhandled (on DEBUG).
+ */
+#ifndef __CONF_COLLISION_LIST_H__
+#define __CONF_COLLISION_LIST_H__
+
+#include <conf/type.h>
+
+#define COLLIDABLE_LIST \
+  X(floor, T_FLOOR) \
+  X(leftCorner, T_LEFT_CORNER) \
+  X(rightCorner, T_RIGHT_CORNER) \
+  X(player, T_PLAYER)
+
+#define COLLISION_LIST \
+  X(floor, floor, ignoreCollision) \
+  X(floor, leftCorner, ignoreCollision) \
+  X(floor, rightCorner, ignoreCollision) \
+  X(leftCorner, leftCorner, ignoreCollision) \
+  X(leftCorner, rightCorner, ignoreCollision) \
+  X(rightCorner, rightCorner, ignoreCollision)
+
+#endif /* __CONF_COLLISION_LIST_H__ */
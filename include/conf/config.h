@@ -27,6 +27,23 @@ struct stConfigCtx {
     gfmVideoBackend videoBackend;
     /** Audio quality */
     gfmAudioQuality audioSettings;
+    /** Dynamic broadphase (as enumerated on base/collision.h) */
+    int broadphase;
+    /** Whether collision pairs are gathered before being resolved */
+    int batchCollision;
+    /** Whether the simulation runs without a (visible) window */
+    int headless;
+    /** Number of frames simulated on headless mode */
+    int headlessFrames;
+    /** Whether the simulation runs on its own thread (decoupled from
+     * rendering) */
+    int threaded;
+    /** Where the profiler's trace is written (or 0, if not profiling) */
+    const char *pProfilePath;
+    /** Where the input is recorded (or 0, if not recording) */
+    const char *pRecordPath;
+    /** Input replayed instead of the devices' (or 0, if not replaying) */
+    const char *pReplayPath;
 };
 typedef struct stConfigCtx configCtx;
 
@@ -41,6 +58,14 @@ typedef struct stConfigCtx configCtx;
     (c).fpsQuality = 60;\
     (c).videoBackend = GFM_VIDEO_SDL2;\
     (c).audioSettings = gfmAudio_defQuality;\
+    (c).broadphase = 0;\
+    (c).batchCollision = 0;\
+    (c).headless = 0;\
+    (c).headlessFrames = 3600;\
+    (c).threaded = 0;\
+    (c).pProfilePath = 0;\
+    (c).pRecordPath = 0;\
+    (c).pReplayPath = 0;\
   } while (0)
 
 #endif /* __CONF_CONFIG_H__ */
@@ -16,6 +16,8 @@
     X(ERR_MALLOC) \
     X(ERR_INDEXOOB) \
     X(ERR_DIDJUMP) \
+    X(ERR_OPENFILE) \
+    X(ERR_BADFILE) \
     X(ERR_MAX)
 
 #endif /* __CONF_ERROR_LIST_H__ */
@@ -18,6 +18,10 @@
 #define TITLE       "GAME_TITLE"
 /** Initial background color (only for the virtual window) */
 #define BG_COLOR    0xFF222034
+/** Maximum number of steps spent waiting for the next state to load on the
+ * background. Afterward, it's loaded synchronously (possibly hitching). If 0,
+ * the current state simply keeps running until the next one is ready */
+#define STATE_LOAD_TIMEOUT 0
 
 #endif /* __CONF_GAME_H__ */
 
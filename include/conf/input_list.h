@@ -62,7 +62,8 @@
      X(qt         , gfmKey_f11) \
      X(gif        , gfmKey_f10) \
      X(dbgStep    , gfmKey_f6) \
-     X(dbgPause   , gfmKey_f5)
+     X(dbgPause   , gfmKey_f5) \
+     X(profile    , gfmKey_f9)
 #else
 #  define X_DEBUG_BUTTON_LIST
 #endif
@@ -0,0 +1,22 @@
+/**
+ * @file include/conf/profiler_list.h
+ *
+ * List of zones timed by the profiler. When defining the 'X macro' for use,
+ * the first parameter is the zone's name (used both for its enumeration and
+ * on the exported trace) and the second is a short description.
+ */
+#ifndef __CONF_PROFILER_LIST_H__
+#define __CONF_PROFILER_LIST_H__
+
+#define PROFILER_ZONE_LIST \
+  X(events    , "gfm_handleEvents") \
+  X(input     , "updateInput (and handleInput)") \
+  X(update    , "Update of the current state") \
+  X(collide   , "Collision of a single object (i.e., collideObject)") \
+  X(resolve   , "Resolution of batched collision pairs") \
+  X(loadLevel , "Switching the level's room or orientation") \
+  X(draw      , "Drawing the current state") \
+  X(drawEnd   , "gfm_drawEnd")
+
+#endif /* __CONF_PROFILER_LIST_H__ */
+
@@ -0,0 +1,23 @@
+/**
+ * @file include/conf/room_list.h
+ *
+ * List of rooms that may be streamed in by the level.
+ *
+ * When defining the 'X macro' for use, the first parameter is the name of the
+ * room (which becomes LR_<name>), the second is its binary level (generated by
+ * 'make maps') and the last is its text version, parsed only if the binary one
+ * can't be loaded. Both are relative to the assets directory (next to the
+ * game's binary), so they are found regardless of the working directory.
+ * Rooms without a text version (i.e., with 0) must always be converted
+ * beforehand.
+ *
+ * The first room is the one loaded by initLevel.
+ */
+#ifndef __CONF_ROOM_LIST_H__
+#define __CONF_ROOM_LIST_H__
+
+#define ROOM_LIST \
+  X(test, "map/test_map.bin", "map/test_map.gfm") \
+  X(tmx_test, "map/tmx/test.bin", 0)
+
+#endif /* __CONF_ROOM_LIST_H__ */
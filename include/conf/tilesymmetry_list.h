@@ -0,0 +1,27 @@
+/**
+ * @file include/conf/tilesymmetry_list.h
+ *
+ * Describe how each tile changes when the level is mirrored. Tiles that aren't
+ * listed are kept as is on every orientation.
+ *
+ * When defining the 'X macro' for use, the first parameter is the tile (in its
+ * default orientation), the second is the tile used when it's horizontally
+ * mirrored, the third is the tile used when it's vertically mirrored and the
+ * last one is the tile used when it's transposed (i.e., mirrored around the
+ * main diagonal). Every other orientation is derived from those three.
+ */
+#ifndef __CONF_TILESYMMETRY_LIST_H__
+#define __CONF_TILESYMMETRY_LIST_H__
+
+#define TILESYMMETRY_LIST \
+  X(64 /* top left */    , 66, 96, 64) \
+  X(65 /* top */         , 65, 97, 80) \
+  X(66 /* top right */   , 64, 98, 96) \
+  X(80 /* left */        , 82, 80, 65) \
+  X(81 /* center */      , 81, 81, 81) \
+  X(82 /* right */       , 80, 82, 97) \
+  X(96 /* bottom left */ , 98, 64, 66) \
+  X(97 /* bottom */      , 97, 65, 82) \
+  X(98 /* bottom right */, 96, 66, 98)
+
+#endif /* __CONF_TILESYMMETRY_LIST_H__ */
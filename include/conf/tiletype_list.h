@@ -0,0 +1,20 @@
+/**
+ * @file include/conf/tiletype_list.h
+ *
+ * List of tile types that may be assigned to tiles on a map file.
+ *
+ * When defining the 'X macro' for use, the first parameter is the name of the
+ * type (as written on the .gfm/.tmx files) and the second is its in-game type
+ * (as defined on conf/type.h).
+ */
+#ifndef __CONF_TILETYPE_LIST_H__
+#define __CONF_TILETYPE_LIST_H__
+
+#include <conf/type.h>
+
+#define TILETYPE_LIST \
+  X(left_corner, T_LEFT_CORNER) \
+  X(right_corner, T_RIGHT_CORNER) \
+  X(floor, T_FLOOR)
+
+#endif /* __CONF_TILETYPE_LIST_H__ */
@@ -17,6 +17,11 @@
  * the same base one will be rendered within the quadtree with the same color.
  */
 #define T_BASE_NBITS 5
+/**
+ * How many bits of a sub-type's id are used to dispatch its collisions. Types
+ * with a greater id are dispatched as their base type.
+ */
+#define T_SUB_NBITS 2
 
 /** Retrieve an object's type (mask out all non-type bits) */
 #define TYPE(type) \
@@ -7,26 +7,68 @@
 #define __LD37_LEVEL_H__
 
 #include <base/error.h>
-#include <GFraMe/gfmTilemap.h>
+#include <conf/room_list.h>
+
+#include <stddef.h>
 
-#define TM_DEF_WIDTH    40
-#define TM_DEF_HEIGHT   30
 #define TM_DEF_TILE     -1
-#define TM_DEF_MAP      "map/test_map.gfm"
-#define TM_DEF_MAP_LEN  (sizeof(TM_DEF_MAP) - 1)
 
-/** The game's main/only tilemap */
-extern gfmTilemap *pMap;
+/**
+ * Maximum number of bytes used to cache generated orientations (other than the
+ * default one, which is always in memory). Each orientation is a plain buffer
+ * of tiles. If negative (the default), the budget is sized from the
+ * current room's dimensions, so every one of its orientations fits. May be
+ * overriden when compiling or through setLevelCacheBudget.
+ */
+#if !defined(LEVEL_CACHE_BUDGET)
+#  define LEVEL_CACHE_BUDGET -1
+#endif
 
+/**
+ * Every symmetry of the (rectangular) level. When transposed, rows and columns
+ * are swapped before mirroring the level, so the rotations are simply a
+ * transposition followed by a mirror.
+ */
 enum enLevelOrientation {
     LO_DEFAULT           = 0x0
   , LO_HORIZONTAL_MIRROR = 0x1
   , LO_VERTICAL_MIRROR   = 0x2
   , LO_MIRROR_BOTH       = (LO_HORIZONTAL_MIRROR | LO_VERTICAL_MIRROR)
+  , LO_TRANSPOSE         = 0x4
+  , LO_ROTATE_CW         = (LO_TRANSPOSE | LO_HORIZONTAL_MIRROR)
+  , LO_ROTATE_CCW        = (LO_TRANSPOSE | LO_VERTICAL_MIRROR)
+  , LO_ANTITRANSPOSE     = (LO_TRANSPOSE | LO_MIRROR_BOTH)
+  , LO_MAX
 };
 typedef enum enLevelOrientation levelOrientation;
 
-/** Initialize the level's static data */
+/** Every room (see conf/room_list.h) */
+enum enLevelRoom {
+#define X(name, ...) LR_##name,
+    ROOM_LIST
+#undef X
+    LR_MAX
+};
+typedef enum enLevelRoom levelRoom;
+
+/** Counters for the cache of generated orientations */
+struct stLevelCacheStats {
+    /** How many times a cached orientation was loaded */
+    int hits;
+    /** How many times a non-cached orientation was loaded */
+    int misses;
+    /** How many times an orientation was generated */
+    int generated;
+    /** How many times an orientation was evicted to respect the budget */
+    int evictions;
+    /** Number of bytes currently cached */
+    size_t usedBytes;
+    /** Maximum number of bytes ever cached at once */
+    size_t peakBytes;
+};
+typedef struct stLevelCacheStats levelCacheStats;
+
+/** Initialize the level's static data and load the first room */
 err initLevel();
 /** Release all static data */
 void cleanLevel();
@@ -37,5 +79,83 @@ void cleanLevel();
  */
 err loadLevel(levelOrientation orientation);
 
+/**
+ * Set the maximum number of bytes used by cached orientations. The current
+ * orientation is always kept, but every other is evicted (least recently used
+ * first) until the cache fits the budget.
+ *
+ * @param  [ in]bytes The new budget (if negative, it's sized from each room's
+ *                    dimensions, so all of its orientations fit)
+ */
+void setLevelCacheBudget(int bytes);
+
+/**
+ * Retrieve the orientation cache's counters
+ *
+ * @param  [out]pStats The counters
+ */
+void getLevelCacheStats(levelCacheStats *pStats);
+
+/**
+ * Start loading a room on the background. Its file is read (or parsed), its
+ * tile types and its default orientation are expanded on a worker thread, so
+ * switching to it afterward only has to swap some pointers. If another room
+ * was being preloaded, this waits for it to finish (and discards it).
+ *
+ * @param  [ in]room The room
+ */
+err preloadRoom(levelRoom room);
+
+/**
+ * Check whether a room may be switched to without waiting for it to load
+ *
+ * @param  [ in]room The room
+ */
+int isRoomReady(levelRoom room);
+
+/**
+ * Switch to another room, keeping the current orientation. If the room wasn't
+ * preloaded, it's loaded right away (blocking the caller). If it couldn't be
+ * loaded, the current room is kept.
+ *
+ * @param  [ in]room The room
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE, ERR_MALLOC, ERR_ARGUMENTBAD
+ */
+err switchRoom(levelRoom room);
+
+/**
+ * Retrieve the current room's dimensions on a given orientation
+ *
+ * @param  [out]pWidth      The width in tiles
+ * @param  [out]pHeight     The height in tiles
+ * @param  [ in]orientation The orientation
+ */
+void getLevelDimensions(int *pWidth, int *pHeight
+        , levelOrientation orientation);
+
+/**
+ * Retrieve a tile of the current room on a given orientation. The tile is read
+ * straight from the room's data, so the orientation doesn't have to be loaded
+ * (nor generated).
+ *
+ * @param  [ in]x           Horizontal position, in tiles, on the orientation
+ * @param  [ in]y           Vertical position, in tiles, on the orientation
+ * @param  [ in]orientation The orientation
+ * @return                  The tile (or TM_DEF_TILE, if out of bounds)
+ */
+int getLevelTile(int x, int y, levelOrientation orientation);
+
+/**
+ * Retrieve the current room's tiles on the current orientation, row by row.
+ * The level doesn't create any tilemap, so this is what should be drawn. The
+ * tiles are only valid until the next loadLevel or switchRoom.
+ *
+ * @param  [out]ppData  The tiles
+ * @param  [out]pWidth  The width in tiles
+ * @param  [out]pHeight The height in tiles
+ * @return              A counter that changes whenever the tiles do
+ */
+unsigned int getLevelData(const int **ppData, int *pWidth, int *pHeight);
+
 #endif /* __LD37_LEVEL_H__ */
 
@@ -0,0 +1,236 @@
+/**
+ * @file include/ld37/levelFile.h
+ *
+ * Compact binary level format. It's generated from the .gfm/.tmx maps by
+ * tools/mapconv.c (run 'make maps') and it's mapped directly into memory by the
+ * game, so no parsing is done on startup.
+ *
+ * Every field is stored as a native (i.e., little endian) 32 bits integer,
+ * except for the tiles, and the file is laid out as:
+ *
+ *   levelFileHeader header;
+ *   int32_t tileTypes[header.numTileTypes * 2]; (pairs of {tile, type})
+ *   uint32_t chunkOffsets[widthInChunks * heightInChunks];
+ *   tile_t chunks[numChunks][LEVEL_CHUNK_SIZE * LEVEL_CHUNK_SIZE];
+ *
+ * Types are stored already resolved into their in-game values (see
+ * conf/tiletype_list.h).
+ *
+ * The tiles are split into square chunks of LEVEL_CHUNK_SIZE tiles, stored row
+ * by row. Chunks on the right and bottom borders are padded with empty tiles.
+ * chunkOffsets holds the position of each chunk from the start of the file,
+ * with empty chunks (i.e., filled with -1) being omitted (and their offset set
+ * to 0). Mostly empty maps therefore take a fraction of their size both on
+ * disk and in memory (as only the used chunks are ever paged in).
+ *
+ * tile_t is the narrowest unsigned integer able to store every tile on the map
+ * (uint8_t, uint16_t or int32_t, as given by header.bytesPerTile). Empty tiles
+ * (i.e., -1) have every bit set (e.g., 0xff on uint8_t levels).
+ */
+#ifndef __LD37_LEVELFILE_H__
+#define __LD37_LEVELFILE_H__
+
+#include <base/error.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** "LD37", as read from a little endian integer */
+#define LEVEL_FILE_MAGIC    0x3733444c
+/** Current version of the format. Must be increased on any change. */
+#define LEVEL_FILE_VERSION  3
+/** Width and height of each chunk, in tiles */
+#define LEVEL_CHUNK_SIZE    32
+/** Number of tiles on each chunk */
+#define LEVEL_CHUNK_TILES   (LEVEL_CHUNK_SIZE * LEVEL_CHUNK_SIZE)
+
+/** Header of every binary level */
+struct stLevelFileHeader {
+    /** Must be LEVEL_FILE_MAGIC */
+    uint32_t magic;
+    /** Must be LEVEL_FILE_VERSION */
+    uint32_t version;
+    /** The map's width in tiles */
+    int32_t widthInTiles;
+    /** The map's height in tiles */
+    int32_t heightInTiles;
+    /** Number of {tile, type} pairs following the header */
+    int32_t numTileTypes;
+    /** Size of each tile, in bytes (either 1, 2 or 4) */
+    int32_t bytesPerTile;
+};
+typedef struct stLevelFileHeader levelFileHeader;
+
+/** The tiles of a level, split into (compact) chunks */
+struct stLevelTiles {
+    /** The map's width in tiles */
+    int widthInTiles;
+    /** The map's height in tiles */
+    int heightInTiles;
+    /** The map's width in chunks */
+    int widthInChunks;
+    /** The map's height in chunks */
+    int heightInChunks;
+    /** Size of each tile, in bytes */
+    int bytesPerTile;
+    /** Every chunk, row by row, in its default orientation (0 if the chunk is
+     * empty). Each has LEVEL_CHUNK_TILES tiles */
+    void **ppChunks;
+    /** Buffer with every non-empty chunk, if they weren't mapped from a file */
+    void *pBuffer;
+    /** Number of non-empty chunks */
+    int numChunks;
+};
+typedef struct stLevelTiles levelTiles;
+
+/** A binary level, mapped into memory (or a text level, parsed into the same
+ * form by openLevelText) */
+struct stLevelFile {
+    /** Start of the mapped file (0 if it was parsed from a text level) */
+    void *pMapping;
+    /** Size of the mapping, in bytes */
+    size_t size;
+    /** Number of {tile, type} pairs in pTileTypes */
+    int numTileTypes;
+    /** List of {tile, type} pairs (points within the mapping, or alloc'ed if
+     * there's none) */
+    int *pTileTypes;
+    /** The tiles (its chunks point within the mapping, if any). Note that the
+     * mapping is private, so modifying it won't change the file */
+    levelTiles tiles;
+};
+typedef struct stLevelFile levelFile;
+
+/** A text level, parsed into plain arrays */
+struct stLevelText {
+    /** The map's width in tiles */
+    int widthInTiles;
+    /** The map's height in tiles */
+    int heightInTiles;
+    /** Every tile, row by row */
+    int *pTiles;
+    /** Number of {tile, type} pairs in pTileTypes */
+    int numTileTypes;
+    /** List of {tile, type} pairs, with the types already resolved */
+    int *pTileTypes;
+};
+typedef struct stLevelText levelText;
+
+/**
+ * Retrieve a tile from a list of compact tiles
+ *
+ * @param  [ in]pTiles       The tiles
+ * @param  [ in]bytesPerTile Size of each tile, in bytes
+ * @param  [ in]i            Index of the tile
+ */
+static inline int readLevelTile(const void *pTiles, int bytesPerTile, int i) {
+    switch (bytesPerTile) {
+        case 1: return (int)(uint8_t)(((const uint8_t*)pTiles)[i] + 1) - 1;
+        case 2: return (int)(uint16_t)(((const uint16_t*)pTiles)[i] + 1) - 1;
+        default: return ((const int32_t*)pTiles)[i];
+    }
+}
+
+/**
+ * Retrieve a tile from a level
+ *
+ * @param  [ in]pTiles The level's tiles
+ * @param  [ in]x      Horizontal position, in tiles (must be within the map)
+ * @param  [ in]y      Vertical position, in tiles (must be within the map)
+ */
+static inline int readLevelTileAt(const levelTiles *pTiles, int x, int y) {
+    const void *pChunk;
+
+    pChunk = pTiles->ppChunks[x / LEVEL_CHUNK_SIZE
+            + (y / LEVEL_CHUNK_SIZE) * pTiles->widthInChunks];
+    if (!pChunk) {
+        return -1;
+    }
+    return readLevelTile(pChunk, pTiles->bytesPerTile
+            , x % LEVEL_CHUNK_SIZE + (y % LEVEL_CHUNK_SIZE) * LEVEL_CHUNK_SIZE);
+}
+
+/**
+ * Retrieve the narrowest size (in bytes) able to store every tile on a map
+ *
+ * @param  [ in]pTiles   The tiles
+ * @param  [ in]numTiles Number of tiles
+ */
+int getLevelTileSize(const int *pTiles, int numTiles);
+
+/**
+ * Convert tiles into their compact form
+ *
+ * @param  [out]pDst         The compact tiles
+ * @param  [ in]pSrc         The tiles
+ * @param  [ in]numTiles     Number of tiles
+ * @param  [ in]bytesPerTile Size of each compact tile (see getLevelTileSize)
+ */
+void packLevelTiles(void *pDst, const int *pSrc, int numTiles
+        , int bytesPerTile);
+
+/**
+ * Split a map into compact chunks, skipping the empty ones
+ *
+ * @param  [out]pTiles The chunks (must be released by freeLevelTiles)
+ * @param  [ in]pData  The map, on its default orientation
+ * @param  [ in]width  The map's width in tiles
+ * @param  [ in]height The map's height in tiles
+ */
+err initLevelTiles(levelTiles *pTiles, const int *pData, int width
+        , int height);
+
+/** Release chunks created by initLevelTiles (it's safe to call it twice) */
+void freeLevelTiles(levelTiles *pTiles);
+
+/**
+ * Map a binary level into memory and validate it.
+ *
+ * @param  [out]pFile The mapped level
+ * @param  [ in]pPath Path to the file (relative to the working directory)
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE
+ */
+err openLevelFile(levelFile *pFile, const char *pPath);
+
+/**
+ * Read a text level (see parseLevelText) into the same form as a binary one,
+ * so it may be used in its place.
+ *
+ * @param  [out]pFile The level (must be released by closeLevelFile)
+ * @param  [ in]pPath Path to the file
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE, ERR_MALLOC
+ */
+err openLevelText(levelFile *pFile, const char *pPath);
+
+/**
+ * Release a level opened by openLevelFile or openLevelText (it's safe to call
+ * it twice)
+ */
+void closeLevelFile(levelFile *pFile);
+
+/**
+ * Resolve a tile type's name into its in-game value (see
+ * conf/tiletype_list.h)
+ *
+ * @param  [out]pType The type
+ * @param  [ in]pName The name (doesn't have to be '\0'-terminated)
+ * @param  [ in]len   Length of the name
+ * @return            ERR_OK, ERR_BADFILE
+ */
+err resolveTileType(int *pType, const char *pName, size_t len);
+
+/**
+ * Parse a GFraMe text level (.gfm). Only 'type' and 'map' tokens are
+ * supported.
+ *
+ * @param  [out]pText The level (must be released by freeLevelText)
+ * @param  [ in]pData The whole file, '\0'-terminated (it's modified while
+ *                    parsing)
+ * @return            ERR_OK, ERR_BADFILE, ERR_MALLOC
+ */
+err parseLevelText(levelText *pText, char *pData);
+
+/** Release a level parsed by parseLevelText (it's safe to call it twice) */
+void freeLevelText(levelText *pText);
+
+#endif /* __LD37_LEVELFILE_H__ */
@@ -0,0 +1,81 @@
+/**
+ * @file include/ld37/mirror.h
+ *
+ * Table-driven kernel that generates the mirrored orientations of a level.
+ *
+ * Tiles are remapped through a per-orientation lookup table, generated from
+ * conf/tilesymmetry_list.h, so no code has to be written for new tilesets. If
+ * compiled with AVX2 support (i.e., 'make AVX2=yes'), 8 tiles are remapped and
+ * reversed at once (transposed orientations are always scalar). Maps are
+ * processed one chunk at a time (see levelFile.h), and huge ones are split
+ * across a few threads.
+ *
+ * Positions may also be converted between orientations, so the level may be
+ * read on any orientation without generating it.
+ */
+#ifndef __LD37_MIRROR_H__
+#define __LD37_MIRROR_H__
+
+#include <ld37/level.h>
+#include <ld37/levelFile.h>
+
+/** Number of tiles on the atlas (i.e., tiles that may be remapped) */
+#define MIRROR_NUM_TILES        256
+/** Minimum number of tiles on a map before it's split across threads */
+#define MIRROR_THREAD_MIN_TILES (512 * 512)
+/** Maximum number of threads used by the kernel */
+#define MIRROR_MAX_THREADS      8
+
+/** Generate the lookup tables for every orientation */
+void initMirrorTables();
+
+/**
+ * Retrieve a tile on a given orientation
+ *
+ * @param  [ in]tile        The tile, in its default orientation
+ * @param  [ in]orientation The new orientation
+ */
+int mirrorTile(int tile, levelOrientation orientation);
+
+/**
+ * Retrieve the position of a tile on a given orientation
+ *
+ * @param  [out]pX          Horizontal position on the new orientation
+ * @param  [out]pY          Vertical position on the new orientation
+ * @param  [ in]x           Horizontal position on the default orientation
+ * @param  [ in]y           Vertical position on the default orientation
+ * @param  [ in]width       The map's width in tiles (on the default one)
+ * @param  [ in]height      The map's height in tiles (on the default one)
+ * @param  [ in]orientation The new orientation
+ */
+void mirrorPosition(int *pX, int *pY, int x, int y, int width, int height
+        , levelOrientation orientation);
+
+/**
+ * Retrieve the position of a tile on the default orientation (i.e., the
+ * inverse of mirrorPosition)
+ *
+ * @param  [out]pX          Horizontal position on the default orientation
+ * @param  [out]pY          Vertical position on the default orientation
+ * @param  [ in]x           Horizontal position on the given orientation
+ * @param  [ in]y           Vertical position on the given orientation
+ * @param  [ in]width       The map's width in tiles (on the default one)
+ * @param  [ in]height      The map's height in tiles (on the default one)
+ * @param  [ in]orientation The orientation of x and y
+ */
+void unmirrorPosition(int *pX, int *pY, int x, int y, int width, int height
+        , levelOrientation orientation);
+
+/**
+ * Generate a new orientation of a map. initMirrorTables must have been called
+ * beforehand.
+ *
+ * @param  [out]pDst        The mirrored map (must not overlap pSrc). If
+ *                          transposed, it's height tiles wide
+ * @param  [ in]pSrc        The map's chunks, in its default orientation
+ * @param  [ in]orientation The new orientation
+ */
+void mirrorTilemap(int *pDst, const levelTiles *pSrc
+        , levelOrientation orientation);
+
+#endif /* __LD37_MIRROR_H__ */
@@ -3,11 +3,23 @@
 #define __LD37_TEST_H__
 
 #include <base/error.h>
+#include <base/snapshot.h>
 
+/** Start loading the test's resources on the background */
+err prepareTest();
+/** Whether initTest may be called without waiting for anything to load */
+int isTestReady();
 err initTest();
 void cleanTest();
 err updateTest();
 err drawTest();
 
+/** Copy the test's drawable state into a snapshot */
+err snapshotTest(snapshot *pSnapshot);
+/** Draw the test from a snapshot (instead of from the level's tilemap) */
+err drawTestSnapshot(const snapshot *pSnapshot);
+/** Release everything used to draw the test (from the rendering thread) */
+void cleanTestRenderer();
+
 #endif /* __LD37_TEST_H__*/
 
@@ -0,0 +1,212 @@
+/**
+ * @file src/base/aabb.c
+ *
+ * Kernel that tests a bounding box against a batch of others at once.
+ *
+ * Each lane compares one candidate against the (broadcast) tested box and the
+ * four comparisons are and'ed into a lane mask, which is then packed into a
+ * bit per candidate. Candidates that don't fill a whole vector are tested by
+ * the scalar loop.
+ *
+ * The swept test is the usual slab test: each axis gives the interval of the
+ * movement in which the boxes overlap on that axis, and they only collide if
+ * both intervals intersect within the movement.
+ */
+#include <base/aabb.h>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#endif
+
+/**
+ * Test a bounding box against a batch of candidates
+ *
+ * @param  [ in]pBoxes The candidates
+ * @param  [ in]first  Index of the first candidate
+ * @param  [ in]count  Number of candidates (at most AABB_BATCH_LEN)
+ * @param  [ in]left   Left edge of the tested box
+ * @param  [ in]top    Top edge of the tested box
+ * @param  [ in]right  Right edge of the tested box (exclusive)
+ * @param  [ in]bottom Bottom edge of the tested box (exclusive)
+ * @return             Mask of overlapping candidates (where bit 'i' is set if
+ *                     the candidate 'first + i' overlaps the box)
+ */
+unsigned int overlapAabbBatch(const aabbArrays *pBoxes, int first, int count
+        , int left, int top, int right, int bottom) {
+    const int *pLeft, *pTop, *pRight, *pBottom;
+    unsigned int mask;
+    int i;
+
+    pLeft = pBoxes->pLeft + first;
+    pTop = pBoxes->pTop + first;
+    pRight = pBoxes->pRight + first;
+    pBottom = pBoxes->pBottom + first;
+    mask = 0;
+    i = 0;
+
+#if defined(__AVX2__)
+    {
+        __m256i vLeft, vTop, vRight, vBottom;
+
+        vLeft = _mm256_set1_epi32(left);
+        vTop = _mm256_set1_epi32(top);
+        vRight = _mm256_set1_epi32(right);
+        vBottom = _mm256_set1_epi32(bottom);
+        while (i + 8 <= count) {
+            __m256i vHit;
+
+            vHit = _mm256_and_si256(
+                    _mm256_cmpgt_epi32(_mm256_loadu_si256(
+                        (const __m256i*)(pRight + i)), vLeft),
+                    _mm256_cmpgt_epi32(vRight, _mm256_loadu_si256(
+                        (const __m256i*)(pLeft + i))));
+            vHit = _mm256_and_si256(vHit,
+                    _mm256_cmpgt_epi32(_mm256_loadu_si256(
+                        (const __m256i*)(pBottom + i)), vTop));
+            vHit = _mm256_and_si256(vHit,
+                    _mm256_cmpgt_epi32(vBottom, _mm256_loadu_si256(
+                        (const __m256i*)(pTop + i))));
+            mask |= (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(vHit))
+                    << i;
+            i += 8;
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        __m128i vLeft, vTop, vRight, vBottom;
+
+        vLeft = _mm_set1_epi32(left);
+        vTop = _mm_set1_epi32(top);
+        vRight = _mm_set1_epi32(right);
+        vBottom = _mm_set1_epi32(bottom);
+        while (i + 4 <= count) {
+            __m128i vHit;
+
+            vHit = _mm_and_si128(
+                    _mm_cmpgt_epi32(_mm_loadu_si128(
+                        (const __m128i*)(pRight + i)), vLeft),
+                    _mm_cmpgt_epi32(vRight, _mm_loadu_si128(
+                        (const __m128i*)(pLeft + i))));
+            vHit = _mm_and_si128(vHit,
+                    _mm_cmpgt_epi32(_mm_loadu_si128(
+                        (const __m128i*)(pBottom + i)), vTop));
+            vHit = _mm_and_si128(vHit,
+                    _mm_cmpgt_epi32(vBottom, _mm_loadu_si128(
+                        (const __m128i*)(pTop + i))));
+            mask |= (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(vHit)) << i;
+            i += 4;
+        }
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    {
+        static const unsigned int laneBits[4] = {1, 2, 4, 8};
+        int32x4_t vLeft, vTop, vRight, vBottom;
+        uint32x4_t vBits;
+
+        vLeft = vdupq_n_s32(left);
+        vTop = vdupq_n_s32(top);
+        vRight = vdupq_n_s32(right);
+        vBottom = vdupq_n_s32(bottom);
+        vBits = vld1q_u32(laneBits);
+        while (i + 4 <= count) {
+            uint32x4_t vHit;
+
+            vHit = vandq_u32(vcgtq_s32(vld1q_s32(pRight + i), vLeft)
+                    , vcgtq_s32(vRight, vld1q_s32(pLeft + i)));
+            vHit = vandq_u32(vHit, vcgtq_s32(vld1q_s32(pBottom + i), vTop));
+            vHit = vandq_u32(vHit, vcgtq_s32(vBottom, vld1q_s32(pTop + i)));
+            vHit = vandq_u32(vHit, vBits);
+            mask |= (vgetq_lane_u32(vHit, 0) | vgetq_lane_u32(vHit, 1)
+                    | vgetq_lane_u32(vHit, 2) | vgetq_lane_u32(vHit, 3)) << i;
+            i += 4;
+        }
+    }
+#endif
+
+    while (i < count) {
+        if (pRight[i] > left && right > pLeft[i] && pBottom[i] > top
+                && bottom > pTop[i]) {
+            mask |= 1u << i;
+        }
+        i++;
+    }
+
+    return mask;
+}
+
+
+/**
+ * Find the interval of a movement in which two ranges overlap, on one axis
+ *
+ * @param  [out]pEnter   Start of the interval (as a fraction of d)
+ * @param  [out]pExit    End of the interval (as a fraction of d)
+ * @param  [ in]pos      Start of the moving range
+ * @param  [ in]len      Length of the moving range
+ * @param  [ in]d        Displacement of the moving range
+ * @param  [ in]otherPos Start of the static range
+ * @param  [ in]otherLen Length of the static range
+ * @return               Whether the ranges ever overlap
+ */
+static int _sweepAxis(double *pEnter, double *pExit, int pos, int len, int d
+        , int otherPos, int otherLen) {
+    if (d == 0) {
+        /* Either always or never overlapping (the interval only has to
+         * contain the whole movement) */
+        *pEnter = -1.0;
+        *pExit = 2.0;
+        return pos < otherPos + otherLen && otherPos < pos + len;
+    }
+    else if (d > 0) {
+        *pEnter = (otherPos - (pos + len)) / (double)d;
+        *pExit = (otherPos + otherLen - pos) / (double)d;
+    }
+    else {
+        *pEnter = (otherPos + otherLen - pos) / (double)d;
+        *pExit = (otherPos - (pos + len)) / (double)d;
+    }
+
+    return 1;
+}
+
+/**
+ * Sweep a bounding box along a displacement, against a static one. The boxes
+ * only collide if they overlap (rather than merely touch) at some point of
+ * the movement.
+ *
+ * @param  [out]pToi        Time of impact, as a fraction of the displacement
+ *                          (0 if the boxes already overlapped at the start)
+ * @param  [ in]x           Left edge of the swept box, at the start
+ * @param  [ in]y           Top edge of the swept box, at the start
+ * @param  [ in]width       Width of the swept box
+ * @param  [ in]height      Height of the swept box
+ * @param  [ in]dx          Horizontal displacement of the swept box
+ * @param  [ in]dy          Vertical displacement of the swept box
+ * @param  [ in]otherX      Left edge of the static box
+ * @param  [ in]otherY      Top edge of the static box
+ * @param  [ in]otherWidth  Width of the static box
+ * @param  [ in]otherHeight Height of the static box
+ * @return                  Whether the boxes collided
+ */
+int sweepAabb(double *pToi, int x, int y, int width, int height, int dx
+        , int dy, int otherX, int otherY, int otherWidth, int otherHeight) {
+    double enterX, exitX, enterY, exitY, enter, exit;
+
+    if (!_sweepAxis(&enterX, &exitX, x, width, dx, otherX, otherWidth)
+            || !_sweepAxis(&enterY, &exitY, y, height, dy, otherY
+                , otherHeight)) {
+        return 0;
+    }
+
+    enter = (enterX > enterY) ? enterX : enterY;
+    exit = (exitX < exitY) ? exitX : exitY;
+    if (enter >= exit || enter >= 1.0 || exit <= 0.0) {
+        return 0;
+    }
+
+    *pToi = (enter > 0.0) ? enter : 0.0;
+    return 1;
+}
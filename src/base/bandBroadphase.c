@@ -0,0 +1,401 @@
+/**
+ * @file src/base/bandBroadphase.c
+ *
+ * Broadphase that finds every overlapping pair at once, sweeping horizontal
+ * bands of the world on their own threads.
+ *
+ * Each band copies every object that touches it, sorts them by their
+ * horizontal position and sweeps them, checking each object only against
+ * the following ones that start before it ends (in batches, through
+ * overlapAabbBatch). A pair is only reported by the band that holds the top
+ * of their overlap (i.e., the greater of their vertical positions), so pairs
+ * are never repeated. Since every band writes to its own buffer, the threads
+ * never share anything but the (read-only) list of objects.
+ */
+#include <base/aabb.h>
+#include <base/bandBroadphase.h>
+#include <base/error.h>
+
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmObject.h>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+/** Initial capacity of the arrays (which are doubled as needed) */
+#define BAND_INITIAL_LEN 64
+
+/** Arguments for sweeping a band */
+struct stBandJob {
+    const bandBroadphase *pBP;
+    band *pBand;
+};
+typedef struct stBandJob bandJob;
+
+/**
+ * Make sure an array may hold at least a few more elements
+ *
+ * @param  [ in]ppArray Pointer to the array
+ * @param  [ in]pMax    The array's capacity (updated if it's expanded)
+ * @param  [ in]len     How many elements must fit on the array
+ * @param  [ in]size    Size of each element
+ */
+static err _expand(void **ppArray, int *pMax, int len, size_t size) {
+    void *pTmp;
+    int max;
+
+    if (len <= *pMax) {
+        return ERR_OK;
+    }
+
+    max = *pMax * 2;
+    if (max == 0) {
+        max = BAND_INITIAL_LEN;
+    }
+    while (max < len) {
+        max *= 2;
+    }
+    pTmp = realloc(*ppArray, size * max);
+    ASSERT(pTmp, ERR_MALLOC);
+    *ppArray = pTmp;
+    *pMax = max;
+
+    return ERR_OK;
+}
+
+/** Order objects by their horizontal position (and then by their ids) */
+static int _compareObjects(const void *pA, const void *pB) {
+    const bandObject *pObj1, *pObj2;
+
+    pObj1 = (const bandObject*)pA;
+    pObj2 = (const bandObject*)pB;
+    if (pObj1->x != pObj2->x) {
+        return (pObj1->x > pObj2->x) - (pObj1->x < pObj2->x);
+    }
+    return pObj1->id - pObj2->id;
+}
+
+/** Order pairs by their ids */
+static int _comparePairs(const void *pA, const void *pB) {
+    const bandPair *pPair1, *pPair2;
+
+    pPair1 = (const bandPair*)pA;
+    pPair2 = (const bandPair*)pB;
+    if (pPair1->id1 != pPair2->id1) {
+        return pPair1->id1 - pPair2->id1;
+    }
+    return pPair1->id2 - pPair2->id2;
+}
+
+/**
+ * Initialize an (empty) band broadphase
+ *
+ * @param  [ in]pBP The broadphase
+ */
+err initBandBroadphase(bandBroadphase *pBP) {
+    memset(pBP, 0x0, sizeof(bandBroadphase));
+
+    return ERR_OK;
+}
+
+/**
+ * Release all memory used by a band broadphase
+ *
+ * @param  [ in]pBP The broadphase
+ */
+void freeBandBroadphase(bandBroadphase *pBP) {
+    int i;
+
+    i = 0;
+    while (i < BAND_MAX_THREADS) {
+        free(pBP->bands[i].pObjects);
+        free(pBP->bands[i].pBounds);
+        free(pBP->bands[i].pPairs);
+        i++;
+    }
+    free(pBP->pObjects);
+    free(pBP->pPairs);
+    memset(pBP, 0x0, sizeof(bandBroadphase));
+}
+
+/**
+ * Remove every object (and pair) from a band broadphase, but keep its memory
+ *
+ * @param  [ in]pBP The broadphase
+ */
+void resetBandBroadphase(bandBroadphase *pBP) {
+    pBP->numObjects = 0;
+    pBP->numPairs = 0;
+}
+
+/**
+ * Add an object to a band broadphase. Its pairs are only found by
+ * findBandPairs.
+ *
+ * @param  [ in]pBP     The broadphase
+ * @param  [ in]pObject The object
+ * @param  [ in]id      Id reported for the object, on overlaps
+ * @param  [ in]layer   Collision layer of the object
+ * @param  [ in]mask    Collision layers that may interact with the object
+ */
+err addBandObject(bandBroadphase *pBP, gfmObject *pObject, int id
+        , unsigned int layer, unsigned int mask) {
+    bandObject *pObj;
+    err erv;
+    gfmRV rv;
+
+    erv = _expand((void**)&pBP->pObjects, &pBP->maxObjects
+            , pBP->numObjects + 1, sizeof(bandObject));
+    ASSERT(erv == ERR_OK, erv);
+
+    pObj = &pBP->pObjects[pBP->numObjects];
+    pObj->id = id;
+    rv = gfmObject_getPosition(&pObj->x, &pObj->y, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    rv = gfmObject_getDimensions(&pObj->width, &pObj->height, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    pObj->layer = layer;
+    pObj->mask = mask;
+    pBP->numObjects++;
+
+    return ERR_OK;
+}
+
+/**
+ * Find every pair on a band
+ *
+ * @param  [ in]pJob The band and the objects
+ */
+static err _sweepBand(const bandJob *pJob) {
+    aabbArrays bounds;
+    band *pBand;
+    int i, num;
+    err erv;
+
+    pBand = pJob->pBand;
+    pBand->numObjects = 0;
+    pBand->numPairs = 0;
+
+    /* Copy every object that touches the band */
+    i = 0;
+    while (i < pJob->pBP->numObjects) {
+        const bandObject *pObj;
+
+        pObj = &pJob->pBP->pObjects[i];
+        if (pObj->y < pBand->bottom && pObj->y + pObj->height > pBand->top) {
+            erv = _expand((void**)&pBand->pObjects, &pBand->maxObjects
+                    , pBand->numObjects + 1, sizeof(bandObject));
+            ASSERT(erv == ERR_OK, erv);
+            pBand->pObjects[pBand->numObjects] = *pObj;
+            pBand->numObjects++;
+        }
+        i++;
+    }
+
+    num = pBand->numObjects;
+    qsort(pBand->pObjects, num, sizeof(bandObject), &_compareObjects);
+
+    /* Split the (sorted) objects into an array for each edge */
+    erv = _expand((void**)&pBand->pBounds, &pBand->maxBounds, num * 4
+            , sizeof(int));
+    ASSERT(erv == ERR_OK, erv);
+    bounds.pLeft = pBand->pBounds;
+    bounds.pTop = pBand->pBounds + num;
+    bounds.pRight = pBand->pBounds + num * 2;
+    bounds.pBottom = pBand->pBounds + num * 3;
+    i = 0;
+    while (i < num) {
+        bounds.pLeft[i] = pBand->pObjects[i].x;
+        bounds.pTop[i] = pBand->pObjects[i].y;
+        bounds.pRight[i] = pBand->pObjects[i].x + pBand->pObjects[i].width;
+        bounds.pBottom[i] = pBand->pObjects[i].y + pBand->pObjects[i].height;
+        i++;
+    }
+
+    i = 0;
+    while (i < num) {
+        const bandObject *pObj;
+        int j, last;
+
+        /* Only objects that start before this one ends may overlap it */
+        pObj = &pBand->pObjects[i];
+        last = i + 1;
+        while (last < num && bounds.pLeft[last] < bounds.pRight[i]) {
+            last++;
+        }
+
+        j = i + 1;
+        while (j < last) {
+            unsigned int hits;
+            int count;
+
+            count = last - j;
+            if (count > AABB_BATCH_LEN) {
+                count = AABB_BATCH_LEN;
+            }
+            hits = overlapAabbBatch(&bounds, j, count, bounds.pLeft[i]
+                    , bounds.pTop[i], bounds.pRight[i], bounds.pBottom[i]);
+            while (hits != 0) {
+                const bandObject *pOther;
+                int top;
+
+                pOther = &pBand->pObjects[j + __builtin_ctz(hits)];
+                hits &= hits - 1;
+                if (!(pObj->mask & pOther->layer)) {
+                    continue;
+                }
+                /* Skip pairs reported by another band */
+                top = pObj->y > pOther->y ? pObj->y : pOther->y;
+                if (top < pBand->top || top >= pBand->bottom) {
+                    continue;
+                }
+
+                erv = _expand((void**)&pBand->pPairs, &pBand->maxPairs
+                        , pBand->numPairs + 1, sizeof(bandPair));
+                ASSERT(erv == ERR_OK, erv);
+                if (pObj->id < pOther->id) {
+                    pBand->pPairs[pBand->numPairs].id1 = pObj->id;
+                    pBand->pPairs[pBand->numPairs].id2 = pOther->id;
+                }
+                else {
+                    pBand->pPairs[pBand->numPairs].id1 = pOther->id;
+                    pBand->pPairs[pBand->numPairs].id2 = pObj->id;
+                }
+                pBand->numPairs++;
+            }
+            j += count;
+        }
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+/** Entry point for the worker threads */
+static void* _bandThread(void *pArg) {
+    bandJob *pJob;
+
+    pJob = (bandJob*)pArg;
+    pJob->pBand->erv = _sweepBand(pJob);
+    return 0;
+}
+#endif
+
+/**
+ * Find every pair of overlapping objects that may interact. The pairs are
+ * stored on pBP->pPairs, sorted by their ids.
+ *
+ * @param  [ in]pBP The broadphase
+ */
+err findBandPairs(bandBroadphase *pBP) {
+    bandJob jobs[BAND_MAX_THREADS];
+    int i, numBands, minY, maxY;
+    err erv;
+#if !(defined(__WIN32) || defined(__WIN32__))
+    pthread_t threads[BAND_MAX_THREADS];
+    int didStart[BAND_MAX_THREADS];
+#endif
+
+    pBP->numPairs = 0;
+    if (pBP->numObjects < 2) {
+        return ERR_OK;
+    }
+
+    numBands = 1;
+#if !(defined(__WIN32) || defined(__WIN32__))
+    if (pBP->numObjects >= BAND_THREAD_MIN_OBJECTS) {
+        long numCpus;
+
+        numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (numCpus > BAND_MAX_THREADS) {
+            numBands = BAND_MAX_THREADS;
+        }
+        else if (numCpus > 1) {
+            numBands = (int)numCpus;
+        }
+    }
+#endif
+
+    /* Split the range of vertical positions into bands of the same height.
+     * The first and last bands extend to infinity, so every pair is
+     * reported by exactly one band */
+    minY = pBP->pObjects[0].y;
+    maxY = minY;
+    i = 1;
+    while (i < pBP->numObjects) {
+        if (pBP->pObjects[i].y < minY) {
+            minY = pBP->pObjects[i].y;
+        }
+        else if (pBP->pObjects[i].y > maxY) {
+            maxY = pBP->pObjects[i].y;
+        }
+        i++;
+    }
+    i = 0;
+    while (i < numBands) {
+        band *pBand;
+
+        pBand = &pBP->bands[i];
+        pBand->top = minY + (int)(((long long)maxY - minY + 1) * i / numBands);
+        pBand->bottom = minY
+                + (int)(((long long)maxY - minY + 1) * (i + 1) / numBands);
+        pBand->erv = ERR_OK;
+        jobs[i].pBP = pBP;
+        jobs[i].pBand = pBand;
+        i++;
+    }
+    pBP->bands[0].top = INT_MIN;
+    pBP->bands[numBands - 1].bottom = INT_MAX;
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+    /* Sweep the first band on this thread and every other on a worker. If a
+     * thread couldn't be started, its band is swept on this thread. */
+    i = 1;
+    while (i < numBands) {
+        didStart[i] = (pthread_create(&threads[i], 0, _bandThread, &jobs[i])
+                == 0);
+        i++;
+    }
+    pBP->bands[0].erv = _sweepBand(&jobs[0]);
+    i = 1;
+    while (i < numBands) {
+        if (didStart[i]) {
+            pthread_join(threads[i], 0);
+        }
+        else {
+            pBP->bands[i].erv = _sweepBand(&jobs[i]);
+        }
+        i++;
+    }
+#else
+    pBP->bands[0].erv = _sweepBand(&jobs[0]);
+#endif
+
+    /* Merge the pairs of every band and sort them, so the result doesn't
+     * depend on the number of bands */
+    i = 0;
+    while (i < numBands) {
+        band *pBand;
+
+        pBand = &pBP->bands[i];
+        ASSERT(pBand->erv == ERR_OK, pBand->erv);
+        erv = _expand((void**)&pBP->pPairs, &pBP->maxPairs
+                , pBP->numPairs + pBand->numPairs, sizeof(bandPair));
+        ASSERT(erv == ERR_OK, erv);
+        memcpy(pBP->pPairs + pBP->numPairs, pBand->pPairs
+                , sizeof(bandPair) * pBand->numPairs);
+        pBP->numPairs += pBand->numPairs;
+        i++;
+    }
+    qsort(pBP->pPairs, pBP->numPairs, sizeof(bandPair), &_comparePairs);
+
+    return ERR_OK;
+}
+
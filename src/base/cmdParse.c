@@ -14,8 +14,18 @@
  *  --fullscreen | -f: Init game in fullscreen mode
  *  --list | -l: List all available resolution
  *  --save | -s: *TODO* Save the current configuration
+ *  --broadphase | -B: Set the dynamic broadphase {quadtree, hash,
+ *                     bands, incremental}
+ *  --batch-collision | -c: Gather every collision pair before resolving them
+ *  --headless | -H: Run the simulation as fast as possible, without drawing
+ *  --frames | -n: Set how many frames are run on headless mode
+ *  --threaded | -t: Run the simulation on its own thread
+ *  --profile | -p: Record a Chrome trace of every frame into a file
+ *  --record | -R: Record the input of every step into a file
+ *  --replay | -P: Replay the input recorded into a file (and exit after it)
  */
 #include <base/cmdParse.h>
+#include <base/collision.h>
 #include <base/error.h>
 #include <base/game.h>
 #include <conf/config.h>
@@ -40,6 +50,19 @@ static void usage() {
     LOG("  --fullscreen | -f: Init game in fullscreen mode\n");
     LOG("  --list | -l: List all available resolution\n");
     LOG("  --save | -s: *TODO* Save the current configuration\n");
+    LOG("  --broadphase | -B: Set the dynamic broadphase {quadtree, hash, "
+            "bands, incremental}\n");
+    LOG("  --batch-collision | -c: Gather every collision pair before "
+            "resolving them\n");
+    LOG("  --headless | -H: Run the simulation as fast as possible, without "
+            "drawing\n");
+    LOG("  --frames | -n: Set how many frames are run on headless mode\n");
+    LOG("  --threaded | -t: Run the simulation on its own thread\n");
+    LOG("  --profile | -p: Record a Chrome trace of every frame into a "
+            "file\n");
+    LOG("  --record | -R: Record the input of every step into a file\n");
+    LOG("  --replay | -P: Replay the input recorded into a file (and exit "
+            "after it)\n");
     LOG("  --help | -h: Print usage\n");
 }
 
@@ -154,6 +177,57 @@ err cmdParse(configCtx *pConfig, int argc, char *argv[]) {
         IS_FLAG("--save", "-s") {
             doSave = 1;
         }
+        IS_FLAG("--broadphase", "-B") {
+            CHECK_PARAM();
+
+            if (strcmp(GET_PARAM(), "quadtree") == 0) {
+                pConfig->broadphase = BP_QUADTREE;
+            }
+            else if (strcmp(GET_PARAM(), "hash") == 0) {
+                pConfig->broadphase = BP_SPATIALHASH;
+            }
+            else if (strcmp(GET_PARAM(), "bands") == 0) {
+                pConfig->broadphase = BP_BANDS;
+            }
+            else if (strcmp(GET_PARAM(), "incremental") == 0) {
+                pConfig->broadphase = BP_INCREMENTAL;
+            }
+            else {
+                return ERR_ARGUMENTBAD;
+            }
+        }
+        IS_FLAG("--batch-collision", "-c") {
+            pConfig->batchCollision = 1;
+        }
+        IS_FLAG("--headless", "-H") {
+            pConfig->headless = 1;
+        }
+        IS_FLAG("--frames", "-n") {
+            CHECK_PARAM();
+
+            GET_NUM(pConfig->headlessFrames);
+            if (pConfig->headlessFrames <= 0) {
+                return ERR_ARGUMENTBAD;
+            }
+        }
+        IS_FLAG("--threaded", "-t") {
+            pConfig->threaded = 1;
+        }
+        IS_FLAG("--profile", "-p") {
+            CHECK_PARAM();
+
+            pConfig->pProfilePath = GET_PARAM();
+        }
+        IS_FLAG("--record", "-R") {
+            CHECK_PARAM();
+
+            pConfig->pRecordPath = GET_PARAM();
+        }
+        IS_FLAG("--replay", "-P") {
+            CHECK_PARAM();
+
+            pConfig->pReplayPath = GET_PARAM();
+        }
         IS_FLAG("--list", "-l") {
             gfmRV rv;
             int len, i = 0;
@@ -184,6 +258,12 @@ err cmdParse(configCtx *pConfig, int argc, char *argv[]) {
         NEXT_TOKEN();
     }
 
+    /* Replays only come from actual devices */
+    if (pConfig->pRecordPath && pConfig->pReplayPath) {
+        LOG("Can't record while replaying!\n");
+        return ERR_ARGUMENTBAD;
+    }
+
     if (doSave) {
         /* TODO Save the configuration */
     }
@@ -3,22 +3,43 @@
  *
  * Declare all setup functions for the collision
  */
+#include <base/bandBroadphase.h>
 #include <base/collision.h>
 #include <base/error.h>
+#include <base/incrementalHash.h>
+#include <base/spatialHash.h>
 
+#include <GFraMe/gfmObject.h>
 #include <GFraMe/gfmQuadtree.h>
 
+#include <stdlib.h>
+
 /** Setup the collision context */
 err setupCollision() {
     gfmRV rv;
-    
+    err erv;
+
+    erv = initCollisionDispatch();
+    if (erv != ERR_OK) {
+        return erv;
+    }
+    collision.nodes.current = -1;
+
     rv = gfmQuadtree_getNew(&collision.pQt);
     if (rv != GFMRV_OK) {
         return ERR_GFMERR;
     }
-    rv = gfmQuadtree_getNew(&collision.pStaticQt);
-    if (rv != GFMRV_OK) {
-        return ERR_GFMERR;
+    erv = initSpatialHash(&collision.hash);
+    if (erv != ERR_OK) {
+        return erv;
+    }
+    erv = initBandBroadphase(&collision.bands);
+    if (erv != ERR_OK) {
+        return erv;
+    }
+    erv = initIncrementalHash(&collision.incremental);
+    if (erv != ERR_OK) {
+        return erv;
     }
 
     return ERR_OK;
@@ -26,11 +47,82 @@ err setupCollision() {
 
 /** Release all memory used by the collision context */
 void cleanCollision() {
+#if defined(DEBUG)
+    printCollisionStats();
+#endif
     if (collision.pQt != 0) {
         gfmQuadtree_free(&collision.pQt);
     }
-    if (collision.pStaticQt != 0) {
-        gfmQuadtree_free(&collision.pStaticQt);
+    freeSpatialHash(&collision.hash);
+    freeBandBroadphase(&collision.bands);
+    freeIncrementalHash(&collision.incremental);
+    cleanCollisionPairs();
+    free(collision.nodes.ppObjects);
+    free(collision.nodes.ppSprites);
+    free(collision.nodes.ppChildren);
+    free(collision.nodes.pTypes);
+    free(collision.nodes.pProxies);
+    collision.nodes.ppObjects = 0;
+    collision.nodes.ppSprites = 0;
+    collision.nodes.ppChildren = 0;
+    collision.nodes.pTypes = 0;
+    collision.nodes.pProxies = 0;
+    collision.nodes.numNodes = 0;
+    collision.nodes.maxNodes = 0;
+    while (collision.proxies.maxProxies > 0) {
+        collision.proxies.maxProxies--;
+        gfmObject_free(&collision.proxies.ppObjects[
+                collision.proxies.maxProxies]);
+    }
+    free(collision.proxies.ppObjects);
+    free(collision.proxies.pIds);
+    free(collision.proxies.pFromX);
+    free(collision.proxies.pFromY);
+    collision.proxies.ppObjects = 0;
+    collision.proxies.pIds = 0;
+    collision.proxies.pFromX = 0;
+    collision.proxies.pFromY = 0;
+    collision.proxies.numProxies = 0;
+}
+
+/**
+ * Remove every object from the dynamic broadphase, so it's ready for a new
+ * frame. The incremental hash only removes the awake objects that weren't
+ * collided on the last frame. The area is ignored by every broadphase but
+ * the quadtree (as the others are unbounded).
+ *
+ * @param  [ in]x      Left position of the quadtree
+ * @param  [ in]y      Top position of the quadtree
+ * @param  [ in]width  Width of the quadtree
+ * @param  [ in]height Height of the quadtree
+ */
+err resetCollision(int x, int y, int width, int height) {
+    gfmRV rv;
+
+    collision.layers = 0;
+    collision.collideTime = 0.0;
+    collision.nodes.numNodes = 0;
+    collision.nodes.current = -1;
+    collision.proxies.numProxies = 0;
+    if (collision.broadphase == BP_SPATIALHASH) {
+        resetSpatialHash(&collision.hash);
+        return ERR_OK;
+    }
+    else if (collision.broadphase == BP_BANDS) {
+        resetBandBroadphase(&collision.bands);
+        return ERR_OK;
+    }
+    else if (collision.broadphase == BP_INCREMENTAL) {
+        beginIncrementalFrame(&collision.incremental);
+        return ERR_OK;
     }
+
+    rv = gfmQuadtree_initRoot(collision.pQt, x, y, width, height, QT_MAX_DEPTH
+            , QT_MAX_NODES);
+    if (rv != GFMRV_OK) {
+        return ERR_GFMERR;
+    }
+
+    return ERR_OK;
 }
 
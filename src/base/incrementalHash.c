@@ -0,0 +1,662 @@
+/**
+ * @file src/base/incrementalHash.c
+ *
+ * Broadphase that keeps objects between frames, only relocating the ones
+ * that moved.
+ *
+ * Objects and cell nodes are kept on flat arrays, with removed entries linked
+ * into free lists (so indexes are stable). Buckets are doubly linked, so an
+ * object's nodes may be removed without walking its cells. Objects are found
+ * from their gfmObject through an open addressing map (with linear probing).
+ */
+#include <base/error.h>
+#include <base/incrementalHash.h>
+
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmObject.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Initial capacity of the arrays (which are doubled as needed) */
+#define INCREMENTALHASH_INITIAL_LEN 64
+
+/** Retrieve the bucket of a cell */
+#define GET_BUCKET(cellX, cellY) \
+    ((((unsigned)(cellX) * 73856093u) ^ ((unsigned)(cellY) * 19349663u)) \
+        & (INCREMENTALHASH_BUCKETS - 1))
+
+/** Retrieve the first position of an object on the map */
+#define GET_MAP_POS(pHash, pObject) \
+    ((unsigned)(((uintptr_t)(pObject) >> 4) * 2654435761u) \
+        & ((pHash)->mapLen - 1))
+
+/**
+ * Make sure an array may hold at least one more element
+ *
+ * @param  [ in]ppArray Pointer to the array
+ * @param  [ in]pMax    The array's capacity (updated if it's expanded)
+ * @param  [ in]len     How many elements are in use
+ * @param  [ in]size    Size of each element
+ */
+static err _expand(void **ppArray, int *pMax, int len, size_t size) {
+    void *pTmp;
+    int max;
+
+    if (len < *pMax) {
+        return ERR_OK;
+    }
+
+    max = *pMax * 2;
+    if (max == 0) {
+        max = INCREMENTALHASH_INITIAL_LEN;
+    }
+    pTmp = realloc(*ppArray, size * max);
+    ASSERT(pTmp, ERR_MALLOC);
+    *ppArray = pTmp;
+    *pMax = max;
+
+    return ERR_OK;
+}
+
+/**
+ * Find the position of an object on the map. If it isn't on the map, the
+ * returned position holds -1 (and it's where the object should be added).
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ */
+static int _findOnMap(incrementalHash *pHash, gfmObject *pObject) {
+    int pos;
+
+    pos = GET_MAP_POS(pHash, pObject);
+    while (pHash->pMap[pos] != -1
+            && pHash->pObjects[pHash->pMap[pos]].pObject != pObject) {
+        pos = (pos + 1) & (pHash->mapLen - 1);
+    }
+
+    return pos;
+}
+
+/**
+ * Make sure the map may hold one more object (keeping it at most half full)
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+static err _expandMap(incrementalHash *pHash) {
+    int i, len;
+
+    if ((pHash->mapUsed + 1) * 2 <= pHash->mapLen) {
+        return ERR_OK;
+    }
+
+    len = pHash->mapLen * 2;
+    if (len == 0) {
+        len = INCREMENTALHASH_INITIAL_LEN * 2;
+    }
+    free(pHash->pMap);
+    pHash->pMap = malloc(sizeof(int) * len);
+    ASSERT(pHash->pMap, ERR_MALLOC);
+    pHash->mapLen = len;
+    memset(pHash->pMap, 0xff, sizeof(int) * len);
+
+    /* Re-add every object (removed objects have no gfmObject) */
+    i = 0;
+    while (i < pHash->numObjects) {
+        if (pHash->pObjects[i].pObject) {
+            pHash->pMap[_findOnMap(pHash, pHash->pObjects[i].pObject)] = i;
+        }
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Remove an entry from the map, moving back every following entry that
+ * wouldn't be found anymore
+ *
+ * @param  [ in]pHash The incremental hash
+ * @param  [ in]pos   Position of the entry
+ */
+static void _removeFromMap(incrementalHash *pHash, int pos) {
+    int mask, next;
+
+    mask = pHash->mapLen - 1;
+    next = (pos + 1) & mask;
+    while (pHash->pMap[next] != -1) {
+        int home;
+
+        home = GET_MAP_POS(pHash, pHash->pObjects[pHash->pMap[next]].pObject);
+        /* Move the entry back unless its home lies within (pos, next] */
+        if (((next - home) & mask) >= ((next - pos) & mask)) {
+            pHash->pMap[pos] = pHash->pMap[next];
+            pos = next;
+        }
+        next = (next + 1) & mask;
+    }
+    pHash->pMap[pos] = -1;
+    pHash->mapUsed--;
+}
+
+/**
+ * Initialize an (empty) incremental hash
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+err initIncrementalHash(incrementalHash *pHash) {
+    memset(pHash, 0x0, sizeof(incrementalHash));
+    clearIncrementalHash(pHash);
+
+    return ERR_OK;
+}
+
+/**
+ * Release all memory used by an incremental hash
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+void freeIncrementalHash(incrementalHash *pHash) {
+    free(pHash->pObjects);
+    free(pHash->pNodes);
+    free(pHash->pMap);
+    free(pHash->pAwake);
+    free(pHash->pOverlaps);
+    memset(pHash, 0x0, sizeof(incrementalHash));
+}
+
+/**
+ * Remove every object (awake or asleep) from an incremental hash, but keep
+ * its memory
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+void clearIncrementalHash(incrementalHash *pHash) {
+    memset(pHash->pBuckets, 0xff, sizeof(pHash->pBuckets));
+    if (pHash->pMap) {
+        memset(pHash->pMap, 0xff, sizeof(int) * pHash->mapLen);
+    }
+    pHash->mapUsed = 0;
+    pHash->numObjects = 0;
+    pHash->freeObject = -1;
+    pHash->numNodes = 0;
+    pHash->freeNode = -1;
+    pHash->numAwake = 0;
+    pHash->numOverlaps = 0;
+    pHash->curOverlap = 0;
+    /* Frame 0 is never used, so new objects are never mistaken as collided */
+    pHash->frame = 1;
+}
+
+/**
+ * Remove every node of an object from its buckets
+ *
+ * @param  [ in]pHash The incremental hash
+ * @param  [ in]index Index of the object
+ */
+static void _removeNodes(incrementalHash *pHash, int index) {
+    int node;
+
+    node = pHash->pObjects[index].firstNode;
+    while (node != -1) {
+        incrementalNode *pNode;
+        int next;
+
+        pNode = &pHash->pNodes[node];
+        if (pNode->prev != -1) {
+            pHash->pNodes[pNode->prev].next = pNode->next;
+        }
+        else {
+            pHash->pBuckets[GET_BUCKET(pNode->cellX, pNode->cellY)] =
+                    pNode->next;
+        }
+        if (pNode->next != -1) {
+            pHash->pNodes[pNode->next].prev = pNode->prev;
+        }
+
+        next = pNode->nextOfObject;
+        pNode->object = pHash->freeNode;
+        pHash->freeNode = node;
+        node = next;
+    }
+    pHash->pObjects[index].firstNode = -1;
+}
+
+/**
+ * Add an object to every cell that it touches
+ *
+ * @param  [ in]pHash The incremental hash
+ * @param  [ in]index Index of the object
+ */
+static err _insertNodes(incrementalHash *pHash, int index) {
+    incrementalObject *pObj;
+    int cellX, cellY, firstX, lastX, lastY;
+    err erv;
+
+    pObj = &pHash->pObjects[index];
+    firstX = pObj->x >> INCREMENTALHASH_CELL_BITS;
+    lastX = (pObj->x + pObj->width - 1) >> INCREMENTALHASH_CELL_BITS;
+    lastY = (pObj->y + pObj->height - 1) >> INCREMENTALHASH_CELL_BITS;
+
+    cellY = pObj->y >> INCREMENTALHASH_CELL_BITS;
+    while (cellY <= lastY) {
+        cellX = firstX;
+        while (cellX <= lastX) {
+            incrementalNode *pNode;
+            unsigned int bucket;
+            int node;
+
+            if (pHash->freeNode != -1) {
+                node = pHash->freeNode;
+                pHash->freeNode = pHash->pNodes[node].object;
+            }
+            else {
+                erv = _expand((void**)&pHash->pNodes, &pHash->maxNodes
+                        , pHash->numNodes, sizeof(incrementalNode));
+                ASSERT(erv == ERR_OK, erv);
+                node = pHash->numNodes;
+                pHash->numNodes++;
+            }
+
+            bucket = GET_BUCKET(cellX, cellY);
+            pNode = &pHash->pNodes[node];
+            pNode->object = index;
+            pNode->cellX = cellX;
+            pNode->cellY = cellY;
+            pNode->prev = -1;
+            pNode->next = pHash->pBuckets[bucket];
+            if (pNode->next != -1) {
+                pHash->pNodes[pNode->next].prev = node;
+            }
+            pHash->pBuckets[bucket] = node;
+            pNode->nextOfObject = pObj->firstNode;
+            pObj->firstNode = node;
+            cellX++;
+        }
+        cellY++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Update the bounds of an object, relocating it only if its cells changed
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]index   Index of the object
+ * @param  [ in]pObject The object
+ */
+static err _updateBounds(incrementalHash *pHash, int index
+        , gfmObject *pObject) {
+    incrementalObject *pObj;
+    int x, y, width, height;
+    gfmRV rv;
+
+    rv = gfmObject_getPosition(&x, &y, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    rv = gfmObject_getDimensions(&width, &height, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+
+    pObj = &pHash->pObjects[index];
+    if (pObj->firstNode != -1 && x == pObj->x && y == pObj->y
+            && width == pObj->width && height == pObj->height) {
+        return ERR_OK;
+    }
+    if (pObj->firstNode != -1
+            && (x >> INCREMENTALHASH_CELL_BITS)
+                == (pObj->x >> INCREMENTALHASH_CELL_BITS)
+            && (y >> INCREMENTALHASH_CELL_BITS)
+                == (pObj->y >> INCREMENTALHASH_CELL_BITS)
+            && ((x + width - 1) >> INCREMENTALHASH_CELL_BITS)
+                == ((pObj->x + pObj->width - 1) >> INCREMENTALHASH_CELL_BITS)
+            && ((y + height - 1) >> INCREMENTALHASH_CELL_BITS)
+                == ((pObj->y + pObj->height - 1)
+                    >> INCREMENTALHASH_CELL_BITS)) {
+        /* Still on the same cells */
+        pObj->x = x;
+        pObj->y = y;
+        pObj->width = width;
+        pObj->height = height;
+        return ERR_OK;
+    }
+
+    _removeNodes(pHash, index);
+    pObj->x = x;
+    pObj->y = y;
+    pObj->width = width;
+    pObj->height = height;
+    return _insertNodes(pHash, index);
+}
+
+/**
+ * Add an object to the list of awake objects
+ *
+ * @param  [ in]pHash The incremental hash
+ * @param  [ in]index Index of the object
+ */
+static err _setAwake(incrementalHash *pHash, int index) {
+    err erv;
+
+    if (pHash->pObjects[index].awakeIndex != -1) {
+        return ERR_OK;
+    }
+
+    erv = _expand((void**)&pHash->pAwake, &pHash->maxAwake, pHash->numAwake
+            , sizeof(int));
+    ASSERT(erv == ERR_OK, erv);
+    pHash->pAwake[pHash->numAwake] = index;
+    pHash->pObjects[index].awakeIndex = pHash->numAwake;
+    pHash->numAwake++;
+
+    return ERR_OK;
+}
+
+/**
+ * Remove an object from the list of awake objects
+ *
+ * @param  [ in]pHash The incremental hash
+ * @param  [ in]index Index of the object
+ */
+static void _setAsleep(incrementalHash *pHash, int index) {
+    int pos, last;
+
+    pos = pHash->pObjects[index].awakeIndex;
+    if (pos == -1) {
+        return;
+    }
+
+    /* Move the last awake object into its place */
+    pHash->numAwake--;
+    last = pHash->pAwake[pHash->numAwake];
+    pHash->pAwake[pos] = last;
+    pHash->pObjects[last].awakeIndex = pos;
+    pHash->pObjects[index].awakeIndex = -1;
+}
+
+/**
+ * Remove an object (and all of its nodes) from the hash
+ *
+ * @param  [ in]pHash The incremental hash
+ * @param  [ in]index Index of the object
+ */
+static void _removeObject(incrementalHash *pHash, int index) {
+    incrementalObject *pObj;
+
+    _removeNodes(pHash, index);
+    _setAsleep(pHash, index);
+    _removeFromMap(pHash, _findOnMap(pHash, pHash->pObjects[index].pObject));
+
+    pObj = &pHash->pObjects[index];
+    pObj->pObject = 0;
+    pObj->id = pHash->freeObject;
+    pHash->freeObject = index;
+}
+
+/**
+ * Retrieve the index of an object, adding it (asleep and without any node)
+ * if it isn't on the hash
+ *
+ * @param  [out]pIndex  Index of the object
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ */
+static err _getObject(int *pIndex, incrementalHash *pHash
+        , gfmObject *pObject) {
+    incrementalObject *pObj;
+    int pos, index;
+    err erv;
+
+    erv = _expandMap(pHash);
+    ASSERT(erv == ERR_OK, erv);
+    pos = _findOnMap(pHash, pObject);
+    if (pHash->pMap[pos] != -1) {
+        *pIndex = pHash->pMap[pos];
+        return ERR_OK;
+    }
+
+    if (pHash->freeObject != -1) {
+        index = pHash->freeObject;
+        pHash->freeObject = pHash->pObjects[index].id;
+    }
+    else {
+        erv = _expand((void**)&pHash->pObjects, &pHash->maxObjects
+                , pHash->numObjects, sizeof(incrementalObject));
+        ASSERT(erv == ERR_OK, erv);
+        index = pHash->numObjects;
+        pHash->numObjects++;
+    }
+
+    pObj = &pHash->pObjects[index];
+    memset(pObj, 0x0, sizeof(incrementalObject));
+    pObj->pObject = pObject;
+    pObj->id = -1;
+    pObj->firstNode = -1;
+    pObj->awakeIndex = -1;
+    pObj->frame = pHash->frame - 1;
+    pHash->pMap[pos] = index;
+    pHash->mapUsed++;
+
+    *pIndex = index;
+    return ERR_OK;
+}
+
+/**
+ * Start a new frame, removing every awake object that wasn't collided since
+ * the last call
+ *
+ * @param  [ in]pHash The incremental hash
+ */
+void beginIncrementalFrame(incrementalHash *pHash) {
+    int i;
+
+    /* Objects are swapped into the removed ones' places, so iterate
+     * backward */
+    i = pHash->numAwake - 1;
+    while (i >= 0) {
+        int index;
+
+        index = pHash->pAwake[i];
+        if (pHash->pObjects[index].frame != pHash->frame) {
+            _removeObject(pHash, index);
+        }
+        i--;
+    }
+
+    pHash->frame++;
+    pHash->numOverlaps = 0;
+    pHash->curOverlap = 0;
+}
+
+/**
+ * Collide an (awake) object against every other on the hash. The object is
+ * added if it wasn't on the hash and relocated if it moved (or woken up, if
+ * asleep). Only objects already collided on this frame and sleeping objects
+ * are reported. The overlapping pairs are retrieved with
+ * getIncrementalOverlap and continueIncrementalHash.
+ *
+ * @param  [out]pDidOverlap Whether the object overlapped anything
+ * @param  [ in]pHash       The incremental hash
+ * @param  [ in]pObject     The object
+ * @param  [ in]id          Id reported for the object, on overlaps
+ * @param  [ in]layer       Collision layer of the object
+ * @param  [ in]mask        Collision layers that may interact with the object
+ */
+err collideIncrementalHash(int *pDidOverlap, incrementalHash *pHash
+        , gfmObject *pObject, int id, unsigned int layer, unsigned int mask) {
+    incrementalObject *pObj;
+    int cellX, cellY, firstX, lastX, lastY, index;
+    err erv;
+
+    erv = _getObject(&index, pHash, pObject);
+    ASSERT(erv == ERR_OK, erv);
+    erv = _setAwake(pHash, index);
+    ASSERT(erv == ERR_OK, erv);
+    erv = _updateBounds(pHash, index, pObject);
+    ASSERT(erv == ERR_OK, erv);
+
+    pObj = &pHash->pObjects[index];
+    pObj->id = id;
+    pObj->layer = layer;
+    pObj->mask = mask;
+    pObj->frame = pHash->frame;
+
+    /* Every query has its own id, so objects on many cells are only checked
+     * once (and the object itself is never checked) */
+    pHash->queryCount++;
+    pObj->lastQuery = pHash->queryCount;
+    pHash->numOverlaps = 0;
+    pHash->curOverlap = 0;
+    pHash->curObject = index;
+
+    firstX = pObj->x >> INCREMENTALHASH_CELL_BITS;
+    lastX = (pObj->x + pObj->width - 1) >> INCREMENTALHASH_CELL_BITS;
+    lastY = (pObj->y + pObj->height - 1) >> INCREMENTALHASH_CELL_BITS;
+
+    cellY = pObj->y >> INCREMENTALHASH_CELL_BITS;
+    while (cellY <= lastY) {
+        cellX = firstX;
+        while (cellX <= lastX) {
+            int node;
+
+            node = pHash->pBuckets[GET_BUCKET(cellX, cellY)];
+            while (node != -1) {
+                incrementalNode *pNode;
+                incrementalObject *pOther;
+
+                pNode = &pHash->pNodes[node];
+                node = pNode->next;
+                if (pNode->cellX != cellX || pNode->cellY != cellY) {
+                    continue;
+                }
+                pOther = &pHash->pObjects[pNode->object];
+                if (pOther->lastQuery == pHash->queryCount) {
+                    continue;
+                }
+                pOther->lastQuery = pHash->queryCount;
+
+                /* Awake objects that weren't collided yet will report this
+                 * pair themselves */
+                if ((pOther->frame != pHash->frame
+                            && pOther->awakeIndex != -1)
+                        || !(mask & pOther->layer)) {
+                    continue;
+                }
+                if (pObj->x < pOther->x + pOther->width
+                        && pOther->x < pObj->x + pObj->width
+                        && pObj->y < pOther->y + pOther->height
+                        && pOther->y < pObj->y + pObj->height) {
+                    erv = _expand((void**)&pHash->pOverlaps
+                            , &pHash->maxOverlaps, pHash->numOverlaps
+                            , sizeof(int));
+                    ASSERT(erv == ERR_OK, erv);
+                    pHash->pOverlaps[pHash->numOverlaps] = pNode->object;
+                    pHash->numOverlaps++;
+                }
+            }
+            cellX++;
+        }
+        cellY++;
+    }
+
+    *pDidOverlap = (pHash->numOverlaps > 0);
+    return ERR_OK;
+}
+
+/**
+ * Retrieve the current overlapping pair
+ *
+ * @param  [out]pId1      Id of the object collided last
+ * @param  [out]pId2      Id of the object overlapping it (or -1, if it's
+ *                        asleep)
+ * @param  [out]ppObject2 The object overlapping it
+ * @param  [ in]pHash     The incremental hash
+ */
+void getIncrementalOverlap(int *pId1, int *pId2, gfmObject **ppObject2
+        , incrementalHash *pHash) {
+    incrementalObject *pOther;
+
+    pOther = &pHash->pObjects[pHash->pOverlaps[pHash->curOverlap]];
+    *pId1 = pHash->pObjects[pHash->curObject].id;
+    *pId2 = -1;
+    if (pOther->frame == pHash->frame) {
+        *pId2 = pOther->id;
+    }
+    *ppObject2 = pOther->pObject;
+}
+
+/**
+ * Move to the next overlapping pair
+ *
+ * @param  [ in]pHash The incremental hash
+ * @return            Whether there's another pair
+ */
+int continueIncrementalHash(incrementalHash *pHash) {
+    pHash->curOverlap++;
+    return pHash->curOverlap < pHash->numOverlaps;
+}
+
+/**
+ * Put an object to sleep (adding it, if it wasn't on the hash). Its bounds
+ * are updated one last time, so it must be woken up before moving again.
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ * @param  [ in]layer   Collision layer of the object
+ * @param  [ in]mask    Collision layers that may interact with the object
+ */
+err sleepIncrementalObject(incrementalHash *pHash, gfmObject *pObject
+        , unsigned int layer, unsigned int mask) {
+    int index;
+    err erv;
+
+    erv = _getObject(&index, pHash, pObject);
+    ASSERT(erv == ERR_OK, erv);
+    erv = _updateBounds(pHash, index, pObject);
+    ASSERT(erv == ERR_OK, erv);
+    pHash->pObjects[index].layer = layer;
+    pHash->pObjects[index].mask = mask;
+    _setAsleep(pHash, index);
+
+    return ERR_OK;
+}
+
+/**
+ * Wake up a sleeping object. It must be collided on every frame, from now
+ * on, or it's removed.
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ */
+err wakeIncrementalObject(incrementalHash *pHash, gfmObject *pObject) {
+    int pos;
+
+    if (pHash->mapLen == 0) {
+        return ERR_OK;
+    }
+    pos = _findOnMap(pHash, pObject);
+    if (pHash->pMap[pos] == -1) {
+        return ERR_OK;
+    }
+
+    return _setAwake(pHash, pHash->pMap[pos]);
+}
+
+/**
+ * Remove an object (awake or asleep) from the hash
+ *
+ * @param  [ in]pHash   The incremental hash
+ * @param  [ in]pObject The object
+ */
+void removeIncrementalObject(incrementalHash *pHash, gfmObject *pObject) {
+    int pos;
+
+    if (pHash->mapLen == 0) {
+        return;
+    }
+    pos = _findOnMap(pHash, pObject);
+    if (pHash->pMap[pos] != -1) {
+        _removeObject(pHash, pHash->pMap[pos]);
+    }
+}
+
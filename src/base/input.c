@@ -5,6 +5,8 @@
 #include <base/error.h>
 #include <base/game.h>
 #include <base/input.h>
+#include <base/profiler.h>
+#include <base/replay.h>
 #include <conf/input_list.h>
 
 #include <GFraMe/gfmError.h>
@@ -21,13 +23,15 @@ typedef enum enInputNames inputNames;
 /**
  * Handle every input that require an immediate action (i.e, those that are more
  * like flags, instead of being interpreted during the game loop).
+ *
+ * @param  [ in]pInput The buttons' states
  */
-void handleInput() {
-    if (DID_JUST_PRESS(pause)) {
+void handleInput(const inputCtx *pInput) {
+    if (IS_STATE_JUSTPRESSED(pInput->pause.state)) {
         /* TODO Pause the game */
     }
 
-    if (DID_JUST_RELEASE(fullscreen)) {
+    if (IS_STATE_JUSTRELEASED(pInput->fullscreen.state)) {
         gfmRV rv;
 
         /* TODO Refactor this keeping the current state */
@@ -42,9 +46,11 @@ void handleInput() {
 /**
  * Handle the debug controls of the game's simulation. These allow the update
  * loop to be paused/resumed or even stepped.
+ *
+ * @param  [ in]pInput The buttons' states
  */
-void handleDebugInput() {
-    if (DID_JUST_RELEASE(dbgPause)) {
+void handleDebugInput(const inputCtx *pInput) {
+    if (IS_STATE_JUSTRELEASED(pInput->dbgPause.state)) {
         /* Toggle pause/resume update loop */
         if (game.debugRunState == DBG_PAUSED) {
             game.debugRunState = DBG_RUNNING;
@@ -54,17 +60,17 @@ void handleDebugInput() {
         }
     }
 
-    if (DID_JUST_RELEASE(dbgStep)) {
+    if (IS_STATE_JUSTRELEASED(pInput->dbgStep.state)) {
         /* Single step & pause update loop */
         game.debugRunState = DBG_STEP;
     }
 
-    if (DID_JUST_RELEASE(qt)) {
+    if (IS_STATE_JUSTRELEASED(pInput->qt.state)) {
         /* Toggle quadtree visibility */
         collision.visibility = !collision.visibility;
     }
 
-    if (DID_JUST_RELEASE(gif)) {
+    if (IS_STATE_JUSTRELEASED(pInput->gif.state)) {
         gfmRV rv;
 
         rv = gfm_didExportGif(game.pCtx);
@@ -72,17 +78,33 @@ void handleDebugInput() {
             rv = gfm_recordGif(game.pCtx, 10000 /* ms */, "anim.gif", 8, 0);
         }
     }
+
+    if (IS_STATE_JUSTRELEASED(pInput->profile.state) && isProfiling) {
+        /* Write everything recorded so far (recording continues) */
+        dumpProfiler();
+    }
 }
 #endif
 
-/** Retrieve the state of every button */
-err updateInput() {
+/**
+ * Retrieve the state of every button. When replaying, the states are read
+ * from the replay, instead (and when recording, they are also written to it).
+ *
+ * @param  [ in]pInput The buttons (which must have been initialized on the
+ *                     global input)
+ */
+err updateInput(inputCtx *pInput) {
     /** List of buttons, used to easily iterate through all virtual buttons */
     button *pButtons;
     inputNames i;
+    err erv;
+
+    if (isReplaying()) {
+        return replayInput(pInput);
+    }
 
     i = 0;
-    pButtons = (button*)(&input);
+    pButtons = (button*)pInput;
     /* Iterate through all buttons and update their state */
     while (i < enInput_count) {
         gfmRV rv;
@@ -94,22 +116,30 @@ err updateInput() {
         i++;
     }
 
+    erv = recordInput(pInput);
+    ASSERT(erv == ERR_OK, erv);
+
     return ERR_OK;
 }
 
-/** Forcefully update every debug button */
-err updateDebugInput() {
-    gfmInput *pInput;
+/**
+ * Forcefully update every debug button
+ *
+ * @param  [ in]pInput The buttons (which must have been initialized on the
+ *                     global input)
+ */
+err updateDebugInput(inputCtx *pInput) {
+    gfmInput *pGfmInput;
     gfmRV rv;
 
-    rv = gfm_getInput(&pInput, game.pCtx);
+    rv = gfm_getInput(&pGfmInput, game.pCtx);
     ASSERT(rv == GFMRV_OK, rv);
 
 #define X(name, ...) \
-    rv = gfmInput_updateVKey(pInput, input.name.handle); \
+    rv = gfmInput_updateVKey(pGfmInput, pInput->name.handle); \
     ASSERT(rv == GFMRV_OK, ERR_GFMERR); \
-    rv = gfm_getKeyState(&input.name.state, &input.name.numPressed, game.pCtx \
-                , input.name.handle); \
+    rv = gfm_getKeyState(&pInput->name.state, &pInput->name.numPressed \
+                , game.pCtx, pInput->name.handle); \
     ASSERT(rv == GFMRV_OK, ERR_GFMERR);
     X_DEBUG_BUTTON_LIST
 #undef X
@@ -6,6 +6,8 @@
 #include <base/gfx.h>
 #include <base/input.h>
 #include <base/mainloop.h>
+#include <base/profiler.h>
+#include <base/replay.h>
 #include <base/setup.h>
 #include <base/static.h>
 
@@ -38,6 +40,8 @@ int main(int argc, char *argv[]) {
 
     erv = mainloop();
 __ret:
+    cleanReplay();
+    cleanProfiler();
     cleanCollision();
     cleanGame();
 
@@ -0,0 +1,313 @@
+/**
+ * @file src/base/profiler.c
+ *
+ * Scoped timers around each phase of a frame, exported as a Chrome trace.
+ *
+ * Every thread owns a ring buffer (found through a thread-local pointer), so
+ * it's the only one writing to it. After writing a sample, the ring's counter
+ * is atomically incremented, publishing the sample. Dumping the trace
+ * copies the samples and then checks the counter once again, discarding any
+ * sample that could have been overwritten while copying.
+ *
+ * The ring buffers rely on GCC/Clang extensions (__thread and the __atomic
+ * builtins), so they are only compiled with ENABLE_PROFILER.
+ */
+#include <base/error.h>
+#include <base/profiler.h>
+#include <conf/profiler_list.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__WIN32) || defined(__WIN32__)
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+/** Whether samples are being taken */
+int isProfiling = 0;
+
+/** Retrieve the current time, in seconds (from an arbitrary point) */
+double getProfilerTime() {
+#if defined(__WIN32) || defined(__WIN32__)
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+#if defined(ENABLE_PROFILER)
+/** A single timed zone */
+struct stProfilerSample {
+    double start;
+    double end;
+    profilerZone zone;
+};
+typedef struct stProfilerSample profilerSample;
+
+/** Samples recorded by a thread */
+struct stProfilerRing {
+    /** The latest samples (indexed by count modulo PROFILER_RING_LEN) */
+    profilerSample pSamples[PROFILER_RING_LEN];
+    /** Number of samples ever recorded (only written by the owner) */
+    unsigned int count;
+    /** Thread's name (or 0) */
+    const char *pName;
+};
+typedef struct stProfilerRing profilerRing;
+
+/** Name of every zone */
+static const char *zoneNames[PZ_MAX] = {
+#define X(name, ...) #name,
+    PROFILER_ZONE_LIST
+#undef X
+};
+
+/** Every claimed ring buffer (published only after being initialized) */
+static profilerRing *pRings[PROFILER_MAX_THREADS];
+/** Number of claimed slots on pRings */
+static int numRings = 0;
+/** Ring buffer of the calling thread (or 0, if it hasn't recorded anything) */
+static __thread profilerRing *pThreadRing = 0;
+/** Set on the thread that failed to claim a ring, so it doesn't retry */
+static __thread int didFailRing = 0;
+/** Where the trace is written */
+static const char *pTracePath = 0;
+/** When profiling started (so timestamps are relative to it) */
+static double startTime = 0.0;
+
+/**
+ * Claim a ring buffer for the calling thread
+ *
+ * @return The ring buffer (or 0, if every slot was claimed)
+ */
+static profilerRing* _claimRing() {
+    profilerRing *pRing;
+    int slot;
+
+    if (didFailRing) {
+        return 0;
+    }
+    slot = __sync_fetch_and_add(&numRings, 1);
+    if (slot >= PROFILER_MAX_THREADS) {
+        didFailRing = 1;
+        return 0;
+    }
+    pRing = malloc(sizeof(profilerRing));
+    if (!pRing) {
+        didFailRing = 1;
+        return 0;
+    }
+    pRing->count = 0;
+    pRing->pName = 0;
+    __atomic_store_n(&pRings[slot], pRing, __ATOMIC_RELEASE);
+
+    pThreadRing = pRing;
+    return pRing;
+}
+
+/**
+ * Start taking samples
+ *
+ * @param  [ in]pPath Where the trace is written (must be kept valid until the
+ *                    profiler is cleaned)
+ */
+err initProfiler(const char *pPath) {
+    ASSERT(pPath, ERR_ARGUMENTBAD);
+
+    pTracePath = pPath;
+    startTime = getProfilerTime();
+    isProfiling = 1;
+
+    return ERR_OK;
+}
+
+/** Write the trace (if profiling) and release every ring buffer */
+void cleanProfiler() {
+    int i;
+
+    if (isProfiling) {
+        dumpProfiler();
+    }
+    isProfiling = 0;
+
+    i = 0;
+    while (i < PROFILER_MAX_THREADS) {
+        free(pRings[i]);
+        pRings[i] = 0;
+        i++;
+    }
+    numRings = 0;
+    pThreadRing = 0;
+}
+
+/**
+ * Name the calling thread on the trace. Threads that record samples without
+ * calling this are simply numbered.
+ *
+ * @param  [ in]pName The thread's name (must be a static string)
+ */
+void setProfilerThread(const char *pName) {
+    profilerRing *pRing;
+
+    if (!isProfiling) {
+        return;
+    }
+    pRing = pThreadRing;
+    if (!pRing) {
+        pRing = _claimRing();
+    }
+    if (pRing) {
+        __atomic_store_n(&pRing->pName, pName, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Record a sample for the calling thread, ending now
+ *
+ * @param  [ in]zone  The zone
+ * @param  [ in]start When the zone started (from getProfilerTime)
+ */
+void addProfilerSample(profilerZone zone, double start) {
+    profilerSample *pSample;
+    profilerRing *pRing;
+    unsigned int count;
+
+    pRing = pThreadRing;
+    if (!pRing) {
+        pRing = _claimRing();
+        if (!pRing) {
+            return;
+        }
+    }
+
+    count = pRing->count;
+    pSample = &pRing->pSamples[count & (PROFILER_RING_LEN - 1)];
+    pSample->start = start;
+    pSample->end = getProfilerTime();
+    pSample->zone = zone;
+    __atomic_store_n(&pRing->count, count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write the samples of a thread into the trace
+ *
+ * @param  [ in]pFile   The trace
+ * @param  [ in]pRing   The thread's ring buffer
+ * @param  [ in]tid     Thread's index
+ * @param  [ in]pCopy   Buffer for copying the samples (PROFILER_RING_LEN long)
+ */
+static void _dumpRing(FILE *pFile, profilerRing *pRing, int tid
+        , profilerSample *pCopy) {
+    unsigned int first, last, i;
+    const char *pName;
+
+    /* Copy the samples, then drop those that may have been overwritten
+     * meanwhile (i.e., the oldest ones, if the owner wrapped around) */
+    last = __atomic_load_n(&pRing->count, __ATOMIC_ACQUIRE);
+    first = 0;
+    if (last > PROFILER_RING_LEN) {
+        first = last - PROFILER_RING_LEN;
+    }
+    i = first;
+    while (i != last) {
+        pCopy[i & (PROFILER_RING_LEN - 1)] =
+                pRing->pSamples[i & (PROFILER_RING_LEN - 1)];
+        i++;
+    }
+    /* The owner may be writing sample i over i - PROFILER_RING_LEN right now.
+     * If it wrapped around a whole ring meanwhile, nothing copied is valid */
+    i = __atomic_load_n(&pRing->count, __ATOMIC_ACQUIRE);
+    if (i - last >= PROFILER_RING_LEN - 1) {
+        first = last;
+    }
+    else if (i - first >= PROFILER_RING_LEN) {
+        first = i - PROFILER_RING_LEN + 1;
+    }
+
+    pName = __atomic_load_n(&pRing->pName, __ATOMIC_ACQUIRE);
+    if (pName) {
+        fprintf(pFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1"
+                ",\"tid\":%i,\"args\":{\"name\":\"%s\"}}", tid, pName);
+    }
+    i = first;
+    while (i != last) {
+        profilerSample *pSample;
+
+        pSample = &pCopy[i & (PROFILER_RING_LEN - 1)];
+        fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i"
+                ",\"ts\":%.3f,\"dur\":%.3f}", zoneNames[pSample->zone], tid
+                , (pSample->start - startTime) * 1e6
+                , (pSample->end - pSample->start) * 1e6);
+        i++;
+    }
+}
+
+/** Write every sample kept so far into the trace (overwriting it) */
+err dumpProfiler() {
+    profilerSample *pCopy;
+    FILE *pFile;
+    int i;
+    err erv;
+
+    ASSERT(pTracePath, ERR_ARGUMENTBAD);
+
+    pFile = 0;
+    pCopy = malloc(sizeof(profilerSample) * PROFILER_RING_LEN);
+    ASSERT_TO(pCopy, erv = ERR_MALLOC, __ret);
+    pFile = fopen(pTracePath, "w");
+    ASSERT_TO(pFile, erv = ERR_OPENFILE, __ret);
+
+    fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1"
+            ",\"args\":{\"name\":\"game\"}}");
+    i = 0;
+    while (i < PROFILER_MAX_THREADS) {
+        profilerRing *pRing;
+
+        pRing = __atomic_load_n(&pRings[i], __ATOMIC_ACQUIRE);
+        if (pRing) {
+            _dumpRing(pFile, pRing, i, pCopy);
+        }
+        i++;
+    }
+    fprintf(pFile, "\n]}\n");
+
+    erv = ERR_OK;
+__ret:
+    if (pFile) {
+        fclose(pFile);
+    }
+    free(pCopy);
+
+    return erv;
+}
+
+#else /* !ENABLE_PROFILER */
+/* No zone is ever timed, so there's nothing to record (and the extensions
+ * used by the ring buffers aren't required) */
+err initProfiler(const char *pPath) {
+    return ERR_OK;
+}
+
+void cleanProfiler() {
+}
+
+void setProfilerThread(const char *pName) {
+}
+
+void addProfilerSample(profilerZone zone, double start) {
+}
+
+err dumpProfiler() {
+    return ERR_OK;
+}
+#endif /* ENABLE_PROFILER */
@@ -0,0 +1,317 @@
+/**
+ * @file src/base/replay.c
+ *
+ * Record the state of every button on each step into a file and replay it
+ * back, in place of the real devices. See include/base/replay.h for the
+ * file's format.
+ *
+ * Only the non-debug buttons are recorded, as the debug ones don't affect the
+ * simulation (they only decide when it runs).
+ */
+#include <base/error.h>
+#include <base/input.h>
+#include <base/replay.h>
+#include <conf/input_list.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/** Every recorded button (the last entry being their count) */
+enum enReplayButtons {
+#define X(name, ...) REPLAY_BUTTON_##name,
+    X_RELEASE_BUTTON_LIST
+#undef X
+    REPLAY_BUTTONS
+};
+
+/** File being recorded or replayed (or 0) */
+static FILE *pReplayFile = 0;
+/** Whether pReplayFile is being replayed (instead of recorded) */
+static int isReplay = 0;
+/** Whether every step was already replayed */
+static int isDone = 0;
+/** Steps without changes (yet to be written or replayed) */
+static unsigned int pendingSteps = 0;
+/** Buttons on the last recorded or replayed step */
+static inputCtx lastInput;
+
+/**
+ * Write an unsigned variable length integer
+ *
+ * @param  [ in]pFile The file
+ * @param  [ in]value The integer
+ */
+static err _writeVarint(FILE *pFile, unsigned int value) {
+    do {
+        int byte;
+
+        byte = value & 0x7f;
+        value >>= 7;
+        if (value) {
+            byte |= 0x80;
+        }
+        ASSERT(fputc(byte, pFile) != EOF, ERR_OPENFILE);
+    } while (value);
+
+    return ERR_OK;
+}
+
+/**
+ * Read an unsigned variable length integer
+ *
+ * @param  [out]pValue The integer
+ * @param  [ in]pFile  The file
+ * @return             ERR_OK, ERR_BADFILE
+ */
+static err _readVarint(unsigned int *pValue, FILE *pFile) {
+    int byte, shift;
+
+    *pValue = 0;
+    shift = 0;
+    do {
+        byte = fgetc(pFile);
+        ASSERT(byte != EOF && shift < 32, ERR_BADFILE);
+        *pValue |= (unsigned int)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return ERR_OK;
+}
+
+/** Write the steps without changes, if any */
+static err _flushPendingSteps() {
+    err erv;
+
+    if (pendingSteps > 0) {
+        erv = _writeVarint(pReplayFile, pendingSteps << 1);
+        ASSERT(erv == ERR_OK, erv);
+        pendingSteps = 0;
+    }
+
+    return ERR_OK;
+}
+
+/** Stop replaying, releasing every button */
+static void _finishReplay() {
+    isDone = 1;
+#define X(name, ...) \
+    lastInput.name.state = gfmInput_released; \
+    lastInput.name.numPressed = 0;
+    X_RELEASE_BUTTON_LIST
+#undef X
+}
+
+/**
+ * Start recording every step read through updateInput
+ *
+ * @param  [ in]pPath The replay
+ * @param  [ in]fps   Update rate of the game
+ */
+err initRecording(const char *pPath, int fps) {
+    replayFileHeader header;
+
+    ASSERT(!pReplayFile, ERR_ARGUMENTBAD);
+
+    pReplayFile = fopen(pPath, "wb");
+    ASSERT(pReplayFile, ERR_OPENFILE);
+    isReplay = 0;
+    isDone = 0;
+    pendingSteps = 0;
+    memset(&lastInput, 0x0, sizeof(lastInput));
+
+    header.magic = REPLAY_FILE_MAGIC;
+    header.version = REPLAY_FILE_VERSION;
+    header.numButtons = REPLAY_BUTTONS;
+    header.fps = fps;
+    ASSERT(fwrite(&header, sizeof(replayFileHeader), 1, pReplayFile) == 1
+            , ERR_OPENFILE);
+
+    return ERR_OK;
+}
+
+/**
+ * Start replaying a file. Afterward, updateInput reads from it, instead of
+ * the devices.
+ *
+ * @param  [out]pFps  Update rate of the recorded game (which should be used)
+ * @param  [ in]pPath The replay
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE
+ */
+err initReplay(int *pFps, const char *pPath) {
+    replayFileHeader header;
+    err erv;
+
+    ASSERT(!pReplayFile, ERR_ARGUMENTBAD);
+
+    pReplayFile = fopen(pPath, "rb");
+    ASSERT(pReplayFile, ERR_OPENFILE);
+    isReplay = 1;
+    isDone = 0;
+    pendingSteps = 0;
+    memset(&lastInput, 0x0, sizeof(lastInput));
+
+    erv = ERR_BADFILE;
+    if (fread(&header, sizeof(replayFileHeader), 1, pReplayFile) != 1
+            || header.magic != REPLAY_FILE_MAGIC
+            || header.version != REPLAY_FILE_VERSION
+            || header.numButtons != REPLAY_BUTTONS
+            || header.fps <= 0) {
+        cleanReplay();
+        return erv;
+    }
+    *pFps = header.fps;
+
+    return ERR_OK;
+}
+
+/** Finish writing the recording (if any) and close the file */
+void cleanReplay() {
+    if (!pReplayFile) {
+        return;
+    }
+
+    if (!isReplay) {
+        _flushPendingSteps();
+    }
+    fclose(pReplayFile);
+    pReplayFile = 0;
+    isReplay = 0;
+}
+
+/** Whether a file is being replayed */
+int isReplaying() {
+    return pReplayFile && isReplay;
+}
+
+/** Whether a file is being recorded */
+int isRecording() {
+    return pReplayFile && !isReplay;
+}
+
+/** Whether the replay has no more steps */
+int isReplayDone() {
+    int c;
+
+    if (!isReplaying()) {
+        return 0;
+    }
+    else if (isDone) {
+        return 1;
+    }
+    else if (pendingSteps > 0) {
+        return 0;
+    }
+
+    c = fgetc(pReplayFile);
+    if (c == EOF) {
+        _finishReplay();
+        return 1;
+    }
+    ungetc(c, pReplayFile);
+    return 0;
+}
+
+/**
+ * Append the state of every button to the recording (if recording)
+ *
+ * @param  [ in]pInput The buttons
+ */
+err recordInput(const inputCtx *pInput) {
+    unsigned int mask, bit;
+    err erv;
+
+    if (!pReplayFile || isReplay) {
+        return ERR_OK;
+    }
+
+    mask = 0;
+    bit = 1;
+#define X(name, ...) \
+    if (pInput->name.state != lastInput.name.state \
+            || pInput->name.numPressed != lastInput.name.numPressed) { \
+        mask |= bit; \
+    } \
+    bit <<= 1;
+    X_RELEASE_BUTTON_LIST
+#undef X
+
+    if (mask == 0) {
+        pendingSteps++;
+        return ERR_OK;
+    }
+
+    erv = _flushPendingSteps();
+    ASSERT(erv == ERR_OK, erv);
+    erv = _writeVarint(pReplayFile, (mask << 1) | 1);
+    ASSERT(erv == ERR_OK, erv);
+
+    bit = 1;
+#define X(name, ...) \
+    if (mask & bit) { \
+        ASSERT(fputc(pInput->name.state & 0xff, pReplayFile) != EOF \
+                , ERR_OPENFILE); \
+        erv = _writeVarint(pReplayFile, pInput->name.numPressed); \
+        ASSERT(erv == ERR_OK, erv); \
+        lastInput.name.state = pInput->name.state; \
+        lastInput.name.numPressed = pInput->name.numPressed; \
+    } \
+    bit <<= 1;
+    X_RELEASE_BUTTON_LIST
+#undef X
+
+    return ERR_OK;
+}
+
+/**
+ * Retrieve the state of every button on the next replayed step. Once the
+ * replay is done, every button is kept released.
+ *
+ * @param  [ in]pInput The buttons
+ */
+err replayInput(inputCtx *pInput) {
+    unsigned int record, bit;
+    err erv;
+
+    ASSERT(isReplaying(), ERR_ARGUMENTBAD);
+
+    if (pendingSteps > 0) {
+        pendingSteps--;
+    }
+    else if (!isReplayDone()) {
+        erv = _readVarint(&record, pReplayFile);
+        ASSERT(erv == ERR_OK, erv);
+
+        if (record & 1) {
+            bit = 1 << 1;
+#define X(name, ...) \
+            if (record & bit) { \
+                unsigned int numPressed; \
+                int state; \
+                \
+                state = fgetc(pReplayFile); \
+                ASSERT(state != EOF, ERR_BADFILE); \
+                erv = _readVarint(&numPressed, pReplayFile); \
+                ASSERT(erv == ERR_OK, erv); \
+                lastInput.name.state = (gfmInputState)state; \
+                lastInput.name.numPressed = (int)numPressed; \
+            } \
+            bit <<= 1;
+            X_RELEASE_BUTTON_LIST
+#undef X
+        }
+        else {
+            ASSERT(record > 0, ERR_BADFILE);
+            /* This step is the first of the run */
+            pendingSteps = (record >> 1) - 1;
+        }
+    }
+
+#define X(name, ...) \
+    pInput->name.state = lastInput.name.state; \
+    pInput->name.numPressed = lastInput.name.numPressed;
+    X_RELEASE_BUTTON_LIST
+#undef X
+
+    return ERR_OK;
+}
+
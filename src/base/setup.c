@@ -4,7 +4,10 @@
  * Implement all initial setup
  */
 #include <base/cmdParse.h>
+#include <base/collision.h>
 #include <base/game.h>
+#include <base/profiler.h>
+#include <base/replay.h>
 #include <base/setup.h>
 #include <conf/config.h>
 #include <conf/game.h>
@@ -12,6 +15,10 @@
 #include <GFraMe/gfmError.h>
 #include <GFraMe/gframe.h>
 
+#if !(defined(__WIN32) || defined(__WIN32__))
+#  include <stdlib.h>
+#endif
+
 /**
  * Basic setup for the game.
  *
@@ -29,6 +36,11 @@
  * startup.
  * Also, input must be manually set up later.
  *
+ * On headless mode, neither audio nor the FPS counter are set up. A window is
+ * still required (as textures and the tilemaps depend on it), but it's kept
+ * as small as possible and, on Linux, created on SDL's dummy video driver (so
+ * no display is required).
+ *
  * @param  [ in]argc    Number of arguments received
  * @param  [ in]argv    List of arguments received
  * @return
@@ -51,6 +63,44 @@ err setupGame(int argc, char *argv[]) {
     erv = cmdParse(&config, argc, argv);
     ASSERT(erv == ERR_OK, erv);
 
+    collision.broadphase = config.broadphase;
+    collision.batch = config.batchCollision
+            || config.broadphase == BP_BANDS;
+    game.threaded = config.threaded;
+    if (config.pProfilePath) {
+        erv = initProfiler(config.pProfilePath);
+        ASSERT(erv == ERR_OK, erv);
+    }
+    /* Replays must run at the rate they were recorded */
+    if (config.pReplayPath) {
+        erv = initReplay(&config.fpsQuality, config.pReplayPath);
+        ASSERT(erv == ERR_OK, erv);
+    }
+    else if (config.pRecordPath) {
+        erv = initRecording(config.pRecordPath, config.fpsQuality);
+        ASSERT(erv == ERR_OK, erv);
+    }
+
+    if (config.headless) {
+        game.headlessFrames = config.headlessFrames;
+#if !(defined(__WIN32) || defined(__WIN32__))
+        /* Unless overridden by the user */
+        setenv("SDL_VIDEODRIVER", "dummy", 0/*overwrite*/);
+#endif
+        rv = gfm_setVideoBackend(game.pCtx, GFM_VIDEO_SWSDL2);
+        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+        rv = gfm_initGameWindow(game.pCtx, V_WIDTH, V_HEIGHT, V_WIDTH,
+                V_HEIGHT, 0/*allow resize*/, 0/*vsync*/);
+        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+
+        /* Only the update rate is used (to retrieve the elapsed time) */
+        rv = gfm_setStateFrameRate(game.pCtx, config.fpsQuality,
+                config.fpsQuality);
+        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+
+        return ERR_OK;
+    }
+
     rv = gfm_setVideoBackend(game.pCtx, config.videoBackend);
     ASSERT(rv == GFMRV_OK, ERR_GFMERR);
     if (config.fullscreen == 0) {
@@ -0,0 +1,140 @@
+/**
+ * @file src/base/snapshot.c
+ *
+ * Triple buffer of the drawable state, used when the simulation runs on its
+ * own thread.
+ *
+ * Each side owns one buffer (back for the simulation, front for the
+ * renderer), while the third one holds the latest published snapshot. Both
+ * publishing and acquiring simply swap an owned buffer with the middle one,
+ * so the lock is only held for exchanging indexes.
+ */
+#include <base/error.h>
+#include <base/snapshot.h>
+#include <conf/state.h>
+
+#include <stdlib.h>
+#include <string.h>
+#if !(defined(__WIN32) || defined(__WIN32__))
+#  include <pthread.h>
+#endif
+
+/** Every snapshot */
+static snapshot buffers[3];
+/** Snapshot being written by the simulation */
+static int back = 0;
+/** Latest published snapshot */
+static int middle = 1;
+/** Snapshot being read by the renderer */
+static int front = 2;
+/** Whether the middle snapshot was published after the last acquire */
+static int isFresh = 0;
+#if !(defined(__WIN32) || defined(__WIN32__))
+/** Synchronizes swapping buffers */
+static pthread_mutex_t snapshotMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/** Initialize (empty) every snapshot */
+err initSnapshots() {
+    int i;
+
+    i = 0;
+    while (i < 3) {
+        memset(&buffers[i], 0x0, sizeof(snapshot));
+        buffers[i].currentState = ST_NONE;
+        i++;
+    }
+    back = 0;
+    middle = 1;
+    front = 2;
+    isFresh = 0;
+
+    return ERR_OK;
+}
+
+/** Release every snapshot */
+void cleanSnapshots() {
+    int i;
+
+    i = 0;
+    while (i < 3) {
+        free(buffers[i].pTiles);
+        buffers[i].pTiles = 0;
+        buffers[i].maxTiles = 0;
+        i++;
+    }
+}
+
+/**
+ * Retrieve the snapshot being written. Must only be called from the
+ * simulation.
+ */
+snapshot* getSnapshotBuffer() {
+    return &buffers[back];
+}
+
+/** Publish the snapshot being written, replacing the previous one */
+void publishSnapshot() {
+    int tmp;
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+    pthread_mutex_lock(&snapshotMutex);
+#endif
+    tmp = middle;
+    middle = back;
+    back = tmp;
+    isFresh = 1;
+#if !(defined(__WIN32) || defined(__WIN32__))
+    pthread_mutex_unlock(&snapshotMutex);
+#endif
+}
+
+/**
+ * Retrieve the latest published snapshot. Must only be called from the
+ * renderer and it's only valid until the next call.
+ */
+const snapshot* getLatestSnapshot() {
+#if !(defined(__WIN32) || defined(__WIN32__))
+    pthread_mutex_lock(&snapshotMutex);
+#endif
+    if (isFresh) {
+        int tmp;
+
+        tmp = middle;
+        middle = front;
+        front = tmp;
+        isFresh = 0;
+    }
+#if !(defined(__WIN32) || defined(__WIN32__))
+    pthread_mutex_unlock(&snapshotMutex);
+#endif
+
+    return &buffers[front];
+}
+
+/**
+ * Copy a tilemap into a snapshot (expanding it as necessary)
+ *
+ * @param  [ in]pSnapshot The snapshot
+ * @param  [ in]pTiles    The tiles
+ * @param  [ in]width     The width in tiles
+ * @param  [ in]height    The height in tiles
+ */
+err setSnapshotTiles(snapshot *pSnapshot, const int *pTiles, int width
+        , int height) {
+    if (width * height > pSnapshot->maxTiles) {
+        int *pTmp;
+
+        pTmp = realloc(pSnapshot->pTiles, sizeof(int) * width * height);
+        ASSERT(pTmp, ERR_MALLOC);
+        pSnapshot->pTiles = pTmp;
+        pSnapshot->maxTiles = width * height;
+    }
+
+    memcpy(pSnapshot->pTiles, pTiles, sizeof(int) * width * height);
+    pSnapshot->widthInTiles = width;
+    pSnapshot->heightInTiles = height;
+
+    return ERR_OK;
+}
+
@@ -0,0 +1,300 @@
+/**
+ * @file src/base/spatialHash.c
+ *
+ * Broadphase that buckets objects into fixed cells.
+ *
+ * Each object is added to every cell that it touches and cells are hashed
+ * into a fixed number of buckets, so the hash covers an unbounded area. Cells
+ * only hold a few objects (as they are about as big as the objects), so
+ * dense clusters never degrade into deep trees.
+ */
+#include <base/error.h>
+#include <base/spatialHash.h>
+
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmObject.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Initial capacity of the arrays (which are doubled as needed) */
+#define SPATIALHASH_INITIAL_LEN 64
+
+/** Retrieve the bucket of a cell */
+#define GET_BUCKET(cellX, cellY) \
+    ((((unsigned)(cellX) * 73856093u) ^ ((unsigned)(cellY) * 19349663u)) \
+        & (SPATIALHASH_BUCKETS - 1))
+
+/**
+ * Make sure an array may hold at least one more element
+ *
+ * @param  [ in]ppArray Pointer to the array
+ * @param  [ in]pMax    The array's capacity (updated if it's expanded)
+ * @param  [ in]len     How many elements are in use
+ * @param  [ in]size    Size of each element
+ */
+static err _expand(void **ppArray, int *pMax, int len, size_t size) {
+    void *pTmp;
+    int max;
+
+    if (len < *pMax) {
+        return ERR_OK;
+    }
+
+    max = *pMax * 2;
+    if (max == 0) {
+        max = SPATIALHASH_INITIAL_LEN;
+    }
+    pTmp = realloc(*ppArray, size * max);
+    ASSERT(pTmp, ERR_MALLOC);
+    *ppArray = pTmp;
+    *pMax = max;
+
+    return ERR_OK;
+}
+
+/**
+ * Initialize an (empty) spatial hash
+ *
+ * @param  [ in]pHash The spatial hash
+ */
+err initSpatialHash(spatialHash *pHash) {
+    memset(pHash, 0x0, sizeof(spatialHash));
+    resetSpatialHash(pHash);
+
+    return ERR_OK;
+}
+
+/**
+ * Release all memory used by a spatial hash
+ *
+ * @param  [ in]pHash The spatial hash
+ */
+void freeSpatialHash(spatialHash *pHash) {
+    free(pHash->pObjects);
+    free(pHash->pNodes);
+    free(pHash->pOverlaps);
+    memset(pHash, 0x0, sizeof(spatialHash));
+}
+
+/**
+ * Remove every object from a spatial hash (but keep its memory)
+ *
+ * @param  [ in]pHash The spatial hash
+ */
+void resetSpatialHash(spatialHash *pHash) {
+    memset(pHash->pBuckets, 0xff, sizeof(pHash->pBuckets));
+    pHash->numObjects = 0;
+    pHash->numNodes = 0;
+    pHash->numOverlaps = 0;
+    pHash->curOverlap = 0;
+}
+
+/**
+ * Add an object to the list of objects (but not to its cells)
+ *
+ * @param  [out]pIndex  Index of the object
+ * @param  [ in]pHash   The spatial hash
+ * @param  [ in]pObject The object
+ * @param  [ in]id      Id reported for the object, on overlaps
+ * @param  [ in]layer   Collision layer of the object
+ * @param  [ in]mask    Collision layers that may interact with the object
+ */
+static err _addObject(int *pIndex, spatialHash *pHash, gfmObject *pObject
+        , int id, unsigned int layer, unsigned int mask) {
+    spatialHashObject *pObj;
+    err erv;
+    gfmRV rv;
+
+    erv = _expand((void**)&pHash->pObjects, &pHash->maxObjects
+            , pHash->numObjects, sizeof(spatialHashObject));
+    ASSERT(erv == ERR_OK, erv);
+
+    pObj = &pHash->pObjects[pHash->numObjects];
+    pObj->id = id;
+    rv = gfmObject_getPosition(&pObj->x, &pObj->y, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    rv = gfmObject_getDimensions(&pObj->width, &pObj->height, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    pObj->layer = layer;
+    pObj->mask = mask;
+    pObj->lastQuery = 0;
+
+    *pIndex = pHash->numObjects;
+    pHash->numObjects++;
+
+    return ERR_OK;
+}
+
+/**
+ * Add an object to every cell that it touches
+ *
+ * @param  [ in]pHash The spatial hash
+ * @param  [ in]index Index of the object
+ */
+static err _insertObject(spatialHash *pHash, int index) {
+    spatialHashObject *pObj;
+    int cellX, cellY, firstX, lastX, lastY;
+    err erv;
+
+    pObj = &pHash->pObjects[index];
+    firstX = pObj->x >> SPATIALHASH_CELL_BITS;
+    lastX = (pObj->x + pObj->width - 1) >> SPATIALHASH_CELL_BITS;
+    lastY = (pObj->y + pObj->height - 1) >> SPATIALHASH_CELL_BITS;
+
+    cellY = pObj->y >> SPATIALHASH_CELL_BITS;
+    while (cellY <= lastY) {
+        cellX = firstX;
+        while (cellX <= lastX) {
+            spatialHashNode *pNode;
+            unsigned int bucket;
+
+            erv = _expand((void**)&pHash->pNodes, &pHash->maxNodes
+                    , pHash->numNodes, sizeof(spatialHashNode));
+            ASSERT(erv == ERR_OK, erv);
+
+            bucket = GET_BUCKET(cellX, cellY);
+            pNode = &pHash->pNodes[pHash->numNodes];
+            pNode->object = index;
+            pNode->cellX = cellX;
+            pNode->cellY = cellY;
+            pNode->next = pHash->pBuckets[bucket];
+            pHash->pBuckets[bucket] = pHash->numNodes;
+            pHash->numNodes++;
+            cellX++;
+        }
+        cellY++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Add an object to a spatial hash, without colliding it
+ *
+ * @param  [ in]pHash   The spatial hash
+ * @param  [ in]pObject The object
+ * @param  [ in]id      Id reported for the object, on overlaps
+ * @param  [ in]layer   Collision layer of the object
+ * @param  [ in]mask    Collision layers that may interact with the object
+ */
+err populateSpatialHash(spatialHash *pHash, gfmObject *pObject, int id
+        , unsigned int layer, unsigned int mask) {
+    int index;
+    err erv;
+
+    erv = _addObject(&index, pHash, pObject, id, layer, mask);
+    ASSERT(erv == ERR_OK, erv);
+
+    return _insertObject(pHash, index);
+}
+
+/**
+ * Collide an object against every other on a spatial hash and then add it.
+ * The overlapping pairs are retrieved with getSpatialHashOverlap and
+ * continueSpatialHash.
+ *
+ * @param  [out]pDidOverlap Whether the object overlapped anything
+ * @param  [ in]pHash       The spatial hash
+ * @param  [ in]pObject     The object
+ * @param  [ in]id          Id reported for the object, on overlaps
+ * @param  [ in]layer       Collision layer of the object
+ * @param  [ in]mask        Collision layers that may interact with the object
+ */
+err collideSpatialHash(int *pDidOverlap, spatialHash *pHash
+        , gfmObject *pObject, int id, unsigned int layer, unsigned int mask) {
+    spatialHashObject *pObj;
+    int cellX, cellY, firstX, lastX, lastY, index;
+    err erv;
+
+    erv = _addObject(&index, pHash, pObject, id, layer, mask);
+    ASSERT(erv == ERR_OK, erv);
+    pObj = &pHash->pObjects[index];
+
+    /* Every query has its own id, so objects on many cells are only checked
+     * once */
+    pHash->queryCount++;
+    pHash->numOverlaps = 0;
+    pHash->curOverlap = 0;
+    pHash->curObject = index;
+
+    firstX = pObj->x >> SPATIALHASH_CELL_BITS;
+    lastX = (pObj->x + pObj->width - 1) >> SPATIALHASH_CELL_BITS;
+    lastY = (pObj->y + pObj->height - 1) >> SPATIALHASH_CELL_BITS;
+
+    cellY = pObj->y >> SPATIALHASH_CELL_BITS;
+    while (cellY <= lastY) {
+        cellX = firstX;
+        while (cellX <= lastX) {
+            int node;
+
+            node = pHash->pBuckets[GET_BUCKET(cellX, cellY)];
+            while (node != -1) {
+                spatialHashNode *pNode;
+                spatialHashObject *pOther;
+
+                pNode = &pHash->pNodes[node];
+                node = pNode->next;
+                if (pNode->cellX != cellX || pNode->cellY != cellY) {
+                    continue;
+                }
+                pOther = &pHash->pObjects[pNode->object];
+                if (pOther->lastQuery == pHash->queryCount) {
+                    continue;
+                }
+                pOther->lastQuery = pHash->queryCount;
+
+                /* Skip pairs that may never interact */
+                if (!(mask & pOther->layer) && !(pOther->mask & layer)) {
+                    continue;
+                }
+                if (pObj->x < pOther->x + pOther->width
+                        && pOther->x < pObj->x + pObj->width
+                        && pObj->y < pOther->y + pOther->height
+                        && pOther->y < pObj->y + pObj->height) {
+                    erv = _expand((void**)&pHash->pOverlaps
+                            , &pHash->maxOverlaps, pHash->numOverlaps
+                            , sizeof(int));
+                    ASSERT(erv == ERR_OK, erv);
+                    pHash->pOverlaps[pHash->numOverlaps] = pNode->object;
+                    pHash->numOverlaps++;
+                }
+            }
+            cellX++;
+        }
+        cellY++;
+    }
+
+    erv = _insertObject(pHash, index);
+    ASSERT(erv == ERR_OK, erv);
+
+    *pDidOverlap = (pHash->numOverlaps > 0);
+    return ERR_OK;
+}
+
+/**
+ * Retrieve the current overlapping pair
+ *
+ * @param  [out]pId1  Id of the object collided last
+ * @param  [out]pId2  Id of the object overlapping it
+ * @param  [ in]pHash The spatial hash
+ */
+void getSpatialHashOverlap(int *pId1, int *pId2, spatialHash *pHash) {
+    int other;
+
+    other = pHash->pOverlaps[pHash->curOverlap];
+    *pId1 = pHash->pObjects[pHash->curObject].id;
+    *pId2 = pHash->pObjects[other].id;
+}
+
+/**
+ * Move to the next overlapping pair
+ *
+ * @param  [ in]pHash The spatial hash
+ * @return            Whether there's another pair
+ */
+int continueSpatialHash(spatialHash *pHash) {
+    pHash->curOverlap++;
+    return pHash->curOverlap < pHash->numOverlaps;
+}
+
@@ -1,11 +1,17 @@
 /**
  * @file src/collision.c
  *
- * Declare only the collision function.
+ * Declare only the collision function (and its dispatch table).
  */
+#include <base/aabb.h>
+#include <base/bandBroadphase.h>
 #include <base/collision.h>
 #include <base/error.h>
 #include <base/game.h>
+#include <base/incrementalHash.h>
+#include <base/profiler.h>
+#include <base/spatialHash.h>
+#include <conf/collision_list.h>
 #include <conf/type.h>
 
 #include <GFraMe/gfmError.h>
@@ -13,52 +19,246 @@
 #include <GFraMe/gfmQuadtree.h>
 #include <GFraMe/gfmSprite.h>
 
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(DEBUG)
+#  include <stdio.h>
+#endif
 #if defined(DEBUG) && !(defined(__WIN32) || defined(__WIN32__))
-#  include <stdlib.h>
 #  include <signal.h>
 #endif
 
-/** Hold all pointers (and the type) for a colliding object */
+/** Initial capacity of the node cache (which is doubled as needed) */
+#define NODE_CACHE_INITIAL_LEN 64
+/** Initial capacity of the pair buffer (which is doubled as needed) */
+#define PAIR_BUFFER_INITIAL_LEN 64
+/** Initial number of proxies (which is doubled as needed) */
+#define PROXY_INITIAL_LEN 8
+
+/**
+ * Hold all pointers (and the type) for a colliding object. Tiles of the static
+ * world have no object, only their bounds (a run of tiles of the same type on
+ * a row).
+ */
 struct stCollisionNode {
     gfmObject *pObject;
     gfmSprite *pSprite;
     void *pChild;
     int type;
+    /** Bounds of a run of static tiles, in pixels (only set if there's no
+     * pObject) */
+    int x;
+    int y;
+    int width;
+    int height;
+    /** Index of the object on the node cache (or -1, if it isn't cached) */
+    int id;
+    /** Time of impact of the pair, as a fraction of the step (always 0,
+     * unless any of the objects was swept) */
+    double toi;
 };
 typedef struct stCollisionNode collisionNode;
 
-/** Merge two types into a single one */
-#define MERGE_TYPES(type1, type2) \
-    (TYPE(type1) | (TYPE(type2) << T_BITS))
+/** A pair of overlapping objects, gathered to be resolved later */
+struct stCollisionPair {
+    /** Entry on the dispatch table (i.e., index1 * CI_MAX + index2), with
+     * the objects already on the listed order */
+    int key;
+    /** Order in which the pair was gathered */
+    int order;
+    collisionNode nodes[2];
+};
+typedef struct stCollisionPair collisionPair;
+
+/** A run of tiles hit by a swept object */
+struct stCollisionHit {
+    /** Order in which the run was found (i.e., row by row) */
+    int order;
+    collisionNode tile;
+};
+typedef struct stCollisionHit collisionHit;
+
+/** Handle the collision between two objects */
+typedef err (*collisionHandler)(collisionNode *pNode1, collisionNode *pNode2);
+
+/** Dense index of every type that may collide. CI_NONE is used for types not
+ * listed on COLLIDABLE_LIST */
+enum enCollisionIndex {
+    CI_NONE = 0,
+#define X(name, type) CI_##name,
+    COLLIDABLE_LIST
+#undef X
+    CI_MAX
+};
+typedef enum enCollisionIndex collisionIndex;
+
+/** Number of types (base type and sub-type) mapped into a collision index */
+#define COLLISION_NUM_TYPES (1 << (T_BASE_NBITS + T_SUB_NBITS))
+
+/** Handler for a pair of collision indexes */
+struct stCollisionEntry {
+    collisionHandler handler;
+    /** Whether the objects must be swapped before calling the handler */
+    int swap;
+};
+typedef struct stCollisionEntry collisionEntry;
+
+/** Map a type (base type and sub-type) into its collision index */
+static unsigned char typeIndex[COLLISION_NUM_TYPES];
+/** Handler for every pair of collision indexes */
+static collisionEntry dispatch[CI_MAX][CI_MAX];
+/** Layers (i.e., 1 << index) that may interact with each collision index */
+static unsigned int collisionMask[CI_MAX];
+/** Pairs gathered (on batch mode) since the last resolveCollision */
+static collisionPair *pPairs = 0;
+static int numPairs = 0;
+static int maxPairs = 0;
+/** Number of pairs gathered since the last resolveCollision (including the
+ * repeated ones), so every pair has a distinct order */
+static int numGathered = 0;
+/** First pair gathered by the current object. Repeated pairs (reported by
+ * the quadtree) can only be found after it (see _dropRepeatedPairs) */
+static int firstQueryPair = 0;
+/** Tiles hit by the current swept object, sorted by their time of impact */
+static collisionHit *pHits = 0;
+static int maxHits = 0;
+#if defined(DEBUG)
+/** How many times each pair collided, in the order reported by the quadtree
+ * (or on the listed order, on batch mode) */
+static unsigned int pairCount[CI_MAX][CI_MAX];
+/** Name of every collision index */
+static const char *indexNames[CI_MAX] = {
+    "none",
+#define X(name, type) #name,
+    COLLIDABLE_LIST
+#undef X
+};
+#endif
 
 /**
- * Check if two entities of the specified type collided.
+ * Retrieve the collision index of a type. Sub-types with an id greater than
+ * what fits on T_SUB_NBITS use their base type's index.
  *
- * It requires two integers:
- *   - isFirstCase: Set if collision triggered for the first case. If 0, it was
- *                  triggered by the second case (and, therefore, the objects
- *                  must be swapped).
- *   - fallthrough: Set to fallthrough the following cases without modifying
- *                  isFirstCase. Only required if multiples CASEs are handled by
- *                  a single block.
+ * @param  [ in]type The type
  */
-#define CASE(type1, type2) \
-    case (MERGE_TYPES(type1, type2)): \
-        if (!fallthrough) { \
-            isFirstCase = 1; \
-        } \
-        fallthrough = 1; \
-    case (MERGE_TYPES(type2, type1)): \
-        fallthrough = 1;
+static inline collisionIndex _getIndex(int type) {
+    type = TYPE(type);
+    if (type >= COLLISION_NUM_TYPES) {
+        type &= (1 << T_BASE_NBITS) - 1;
+    }
+    return (collisionIndex)typeIndex[type];
+}
 
-/** Ignore collision with entities of the same type */
-#define IGNORESELF(type) \
-    case (MERGE_TYPES(type, type)):
+/** Collision that doesn't require any handling */
+static err ignoreCollision(collisionNode *pNode1, collisionNode *pNode2) {
+    return ERR_OK;
+}
 
-/** Ignore collision between entities of different types */
-#define IGNORE(type1, type2) \
-    case (MERGE_TYPES(type1, type2)): \
-    case (MERGE_TYPES(type2, type1)):
+/**
+ * Collision between types without any handler.
+ *
+ * On Linux, a SIGINT is raised any time a unhandled collision happens. When
+ * debugging, GDB will stop here and allow the user to check which types
+ * weren't handled.
+ */
+static err _unhandledCollision(collisionNode *pNode1, collisionNode *pNode2) {
+#if defined(DEBUG) && !(defined(__WIN32) || defined(__WIN32__))
+    /* Unfiltered collision, do something about it */
+    raise(SIGINT);
+    return ERR_GFMERR;
+#else
+    return ERR_OK;
+#endif
+}
+
+/**
+ * Generate the dispatch table and the collision masks from COLLIDABLE_LIST and
+ * COLLISION_LIST.
+ *
+ * Pairs handled by ignoreCollision are removed from the masks, so they are
+ * never generated. Pairs that aren't listed are kept, so they are still
+ * reported on DEBUG.
+ */
+err initCollisionDispatch() {
+    int i, j;
+
+    /* Each index must fit as a bit on the masks */
+    ASSERT(CI_MAX <= sizeof(unsigned int) * 8, ERR_INDEXOOB);
+
+    i = 0;
+    while (i < CI_MAX) {
+        collisionMask[i] = ~0u;
+        j = 0;
+        while (j < CI_MAX) {
+            dispatch[i][j].handler = &_unhandledCollision;
+            dispatch[i][j].swap = 0;
+            j++;
+        }
+        i++;
+    }
+
+#define X(name, type) \
+    ASSERT(TYPE(type) < COLLISION_NUM_TYPES, ERR_INDEXOOB); \
+    typeIndex[TYPE(type)] = CI_##name;
+    COLLIDABLE_LIST
+#undef X
+
+    /* The swapped entry is set first, so pairs of a single type keep the
+     * listed order */
+#define X(name1, name2, fn) \
+    dispatch[CI_##name2][CI_##name1].handler = &fn; \
+    dispatch[CI_##name2][CI_##name1].swap = 1; \
+    dispatch[CI_##name1][CI_##name2].handler = &fn; \
+    dispatch[CI_##name1][CI_##name2].swap = 0; \
+    if (&fn == &ignoreCollision) { \
+        collisionMask[CI_##name1] &= ~(1u << CI_##name2); \
+        collisionMask[CI_##name2] &= ~(1u << CI_##name1); \
+    }
+    COLLISION_LIST
+#undef X
+
+    return ERR_OK;
+}
+
+#if defined(DEBUG)
+/** Print how many times each pair of types collided */
+void printCollisionStats() {
+    int i, j;
+
+    i = 0;
+    while (i < CI_MAX) {
+        j = 0;
+        while (j < CI_MAX) {
+            if (pairCount[i][j] > 0) {
+                printf("collision %s x %s: %u\n", indexNames[i]
+                        , indexNames[j], pairCount[i][j]);
+            }
+            j++;
+        }
+        i++;
+    }
+}
+#endif
+
+/**
+ * Retrieve the collision layer of a type (i.e., a bit that identifies it on
+ * the collision masks)
+ *
+ * @param  [ in]type The type
+ */
+unsigned int getCollisionLayer(int type) {
+    return 1u << _getIndex(type);
+}
+
+/**
+ * Retrieve the collision layers that may interact with a type
+ *
+ * @param  [ in]type The type
+ */
+unsigned int getCollisionMask(int type) {
+    return collisionMask[_getIndex(type)];
+}
 
 /**
  * Retrieve the type and all the children for a given object.
@@ -74,60 +274,982 @@ static void _getSubtype(collisionNode *pNode) {
     }
 }
 
+/**
+ * Add a resolved object to the node cache
+ *
+ * @param  [out]pId   Index of the object on the cache
+ * @param  [ in]pNode The object (already resolved by _getSubtype)
+ */
+static err _cacheNode(int *pId, collisionNode *pNode) {
+    collisionNodeCache *pCache;
+
+    pCache = &collision.nodes;
+    if (pCache->numNodes >= pCache->maxNodes) {
+        void *pTmp;
+        int max;
+
+        max = pCache->maxNodes * 2;
+        if (max == 0) {
+            max = NODE_CACHE_INITIAL_LEN;
+        }
+        pTmp = realloc(pCache->ppObjects, sizeof(gfmObject*) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pCache->ppObjects = pTmp;
+        pTmp = realloc(pCache->ppSprites, sizeof(gfmSprite*) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pCache->ppSprites = pTmp;
+        pTmp = realloc(pCache->ppChildren, sizeof(void*) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pCache->ppChildren = pTmp;
+        pTmp = realloc(pCache->pTypes, sizeof(int) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pCache->pTypes = pTmp;
+        pTmp = realloc(pCache->pProxies, sizeof(int) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pCache->pProxies = pTmp;
+        pCache->maxNodes = max;
+    }
+
+    *pId = pCache->numNodes;
+    pCache->ppObjects[*pId] = pNode->pObject;
+    pCache->ppSprites[*pId] = pNode->pSprite;
+    pCache->ppChildren[*pId] = pNode->pChild;
+    pCache->pTypes[*pId] = pNode->type;
+    pCache->pProxies[*pId] = -1;
+    pCache->numNodes++;
+
+    return ERR_OK;
+}
+
+/**
+ * Retrieve an object from the node cache
+ *
+ * @param  [out]pNode The object
+ * @param  [ in]id    Index of the object on the cache
+ */
+static inline void _loadNode(collisionNode *pNode, int id) {
+    pNode->pObject = collision.nodes.ppObjects[id];
+    pNode->pSprite = collision.nodes.ppSprites[id];
+    pNode->pChild = collision.nodes.ppChildren[id];
+    pNode->type = collision.nodes.pTypes[id];
+    pNode->id = id;
+}
+
+/**
+ * Retrieve the object added to the broadphases for a cached object (i.e.,
+ * its proxy, if it was swept)
+ *
+ * @param  [ in]id Index of the object on the cache
+ */
+static inline gfmObject* _getAddedObject(int id) {
+    int proxy;
+
+    proxy = collision.nodes.pProxies[id];
+    if (proxy != -1) {
+        return collision.proxies.ppObjects[proxy];
+    }
+    return collision.nodes.ppObjects[id];
+}
+
+/**
+ * Resolve an object reported by a quadtree. The object being collided was
+ * already resolved by collideObject, so only the other one is looked up.
+ * Proxies are resolved into their swept objects.
+ *
+ * @param  [ in]pNode The object (with a valid gfmObject)
+ */
+static inline void _resolveNode(collisionNode *pNode) {
+    int cur, i;
+
+    cur = collision.nodes.current;
+    if (cur >= 0 && pNode->pObject == _getAddedObject(cur)) {
+        _loadNode(pNode, cur);
+        return;
+    }
+
+    /* Only a few objects are expected to be swept on each frame */
+    i = 0;
+    while (i < collision.proxies.numProxies) {
+        if (pNode->pObject == collision.proxies.ppObjects[i]) {
+            _loadNode(pNode, collision.proxies.pIds[i]);
+            return;
+        }
+        i++;
+    }
+
+    pNode->pSprite = 0;
+    pNode->id = -1;
+    _getSubtype(pNode);
+}
+
+/**
+ * Retrieve the bounds of an object at the start of the step and how much it
+ * moved since
+ *
+ * @param  [out]pX      Left position, at the start
+ * @param  [out]pY      Top position, at the start
+ * @param  [out]pWidth  Width of the object
+ * @param  [out]pHeight Height of the object
+ * @param  [out]pDx     Horizontal displacement (0, if it wasn't swept)
+ * @param  [out]pDy     Vertical displacement (0, if it wasn't swept)
+ * @param  [ in]pNode   The object
+ */
+static err _getMovement(int *pX, int *pY, int *pWidth, int *pHeight
+        , int *pDx, int *pDy, collisionNode *pNode) {
+    int proxy;
+    gfmRV rv;
+
+    *pDx = 0;
+    *pDy = 0;
+    if (!pNode->pObject) {
+        *pX = pNode->x;
+        *pY = pNode->y;
+        *pWidth = pNode->width;
+        *pHeight = pNode->height;
+        return ERR_OK;
+    }
+
+    rv = gfmObject_getPosition(pX, pY, pNode->pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    rv = gfmObject_getDimensions(pWidth, pHeight, pNode->pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    proxy = -1;
+    if (pNode->id != -1) {
+        proxy = collision.nodes.pProxies[pNode->id];
+    }
+    if (proxy != -1) {
+        *pDx = *pX - collision.proxies.pFromX[proxy];
+        *pDy = *pY - collision.proxies.pFromY[proxy];
+        *pX = collision.proxies.pFromX[proxy];
+        *pY = collision.proxies.pFromY[proxy];
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Check whether a pair with a swept object actually collided along the
+ * movement, setting its time of impact. Pairs without any swept object (which
+ * were already tested by the broadphase) always collide.
+ *
+ * @param  [out]pDidHit Whether the pair collided
+ * @param  [ in]pNode1  One of the objects
+ * @param  [ in]pNode2  The other object
+ */
+static err _sweepPair(int *pDidHit, collisionNode *pNode1
+        , collisionNode *pNode2) {
+    int x1, y1, width1, height1, dx1, dy1;
+    int x2, y2, width2, height2, dx2, dy2;
+    double toi;
+    err erv;
+
+    pNode1->toi = 0.0;
+    pNode2->toi = 0.0;
+    *pDidHit = 1;
+    if (collision.proxies.numProxies == 0) {
+        return ERR_OK;
+    }
+    if ((pNode1->id == -1 || collision.nodes.pProxies[pNode1->id] == -1)
+            && (pNode2->id == -1
+                || collision.nodes.pProxies[pNode2->id] == -1)) {
+        return ERR_OK;
+    }
+
+    erv = _getMovement(&x1, &y1, &width1, &height1, &dx1, &dy1, pNode1);
+    ASSERT(erv == ERR_OK, erv);
+    erv = _getMovement(&x2, &y2, &width2, &height2, &dx2, &dy2, pNode2);
+    ASSERT(erv == ERR_OK, erv);
+
+    /* Sweep the first object relative to the second one */
+    toi = 0.0;
+    *pDidHit = sweepAabb(&toi, x1, y1, width1, height1, dx1 - dx2, dy1 - dy2
+            , x2, y2, width2, height2);
+    pNode1->toi = toi;
+    pNode2->toi = toi;
+
+    return ERR_OK;
+}
+
+/**
+ * Order two nodes by their object (or by the position of their run of tiles).
+ * Only used to find repeated nodes, as objects are ordered by their address.
+ *
+ * @param  [ in]pNode1 One of the objects
+ * @param  [ in]pNode2 The other object
+ */
+static inline int _compareNodes(const collisionNode *pNode1
+        , const collisionNode *pNode2) {
+    if (pNode1->pObject != pNode2->pObject) {
+        return (uintptr_t)pNode1->pObject < (uintptr_t)pNode2->pObject
+                ? -1 : 1;
+    }
+    else if (pNode1->pObject != 0) {
+        return 0;
+    }
+    else if (pNode1->x != pNode2->x) {
+        return pNode1->x - pNode2->x;
+    }
+    return pNode1->y - pNode2->y;
+}
+
+/**
+ * Order two pairs by their objects, regardless of which one is listed first
+ *
+ * @param  [ in]pPair1 One of the pairs
+ * @param  [ in]pPair2 The other pair
+ */
+static int _comparePairNodes(const collisionPair *pPair1
+        , const collisionPair *pPair2) {
+    const collisionNode *pNodes1[2], *pNodes2[2];
+    int cmp;
+
+    cmp = _compareNodes(&pPair1->nodes[0], &pPair1->nodes[1]) > 0;
+    pNodes1[0] = &pPair1->nodes[cmp];
+    pNodes1[1] = &pPair1->nodes[!cmp];
+    cmp = _compareNodes(&pPair2->nodes[0], &pPair2->nodes[1]) > 0;
+    pNodes2[0] = &pPair2->nodes[cmp];
+    pNodes2[1] = &pPair2->nodes[!cmp];
+
+    cmp = _compareNodes(pNodes1[0], pNodes2[0]);
+    if (cmp == 0) {
+        cmp = _compareNodes(pNodes1[1], pNodes2[1]);
+    }
+    return cmp;
+}
+
+/**
+ * Order pairs by their objects and then by the order they were gathered, so
+ * repeated pairs end up right after the one gathered first
+ */
+static int _compareRepeatedPairs(const void *pA, const void *pB) {
+    const collisionPair *pPair1, *pPair2;
+    int cmp;
+
+    pPair1 = (const collisionPair*)pA;
+    pPair2 = (const collisionPair*)pB;
+    cmp = _comparePairNodes(pPair1, pPair2);
+    if (cmp == 0) {
+        cmp = pPair1->order - pPair2->order;
+    }
+    return cmp;
+}
+
+/**
+ * Remove every pair gathered more than once by the current object (keeping
+ * the first one). Pairs are sorted (only among themselves), so the repeated
+ * ones are next to each other, and their order is restored by
+ * resolveCollision.
+ */
+static void _dropRepeatedPairs() {
+    int i, last;
+
+    if (numPairs - firstQueryPair < 2) {
+        return;
+    }
+    qsort(&pPairs[firstQueryPair], numPairs - firstQueryPair
+            , sizeof(collisionPair), &_compareRepeatedPairs);
+
+    last = firstQueryPair;
+    i = firstQueryPair + 1;
+    while (i < numPairs) {
+        if (_comparePairNodes(&pPairs[i], &pPairs[last]) != 0) {
+            last++;
+            pPairs[last] = pPairs[i];
+        }
+        i++;
+    }
+    numPairs = last + 1;
+}
+
+/**
+ * Add a pair to the pair buffer. Repeated pairs are only removed once the
+ * current object finishes colliding (see _dropRepeatedPairs).
+ *
+ * @param  [ in]pNode1 The object expected first by the handler
+ * @param  [ in]pNode2 The object expected second by the handler
+ * @param  [ in]key    Entry on the dispatch table
+ */
+static err _gatherPair(collisionNode *pNode1, collisionNode *pNode2
+        , int key) {
+    collisionPair *pPair;
+
+    if (numPairs >= maxPairs) {
+        int max;
+
+        max = maxPairs * 2;
+        if (max == 0) {
+            max = PAIR_BUFFER_INITIAL_LEN;
+        }
+        pPair = realloc(pPairs, sizeof(collisionPair) * max);
+        ASSERT(pPair, ERR_MALLOC);
+        pPairs = pPair;
+        maxPairs = max;
+    }
+
+    pPair = &pPairs[numPairs];
+    pPair->key = key;
+    pPair->order = numGathered;
+    pPair->nodes[0] = *pNode1;
+    pPair->nodes[1] = *pNode2;
+    numPairs++;
+    numGathered++;
+
+    return ERR_OK;
+}
+
+/**
+ * Call the handler for a pair of objects (in the order expected by it). On
+ * batch mode, the pair is gathered instead.
+ *
+ * @param  [ in]pNode1 One of the objects
+ * @param  [ in]pNode2 The other object
+ */
+static inline err _dispatch(collisionNode *pNode1, collisionNode *pNode2) {
+    collisionEntry *pEntry;
+    collisionIndex index1, index2;
+    collisionNode *pNodes[2];
+
+    index1 = _getIndex(pNode1->type);
+    index2 = _getIndex(pNode2->type);
+    pEntry = &dispatch[index1][index2];
+    pNodes[0] = pNode1;
+    pNodes[1] = pNode2;
+    if (collision.batch) {
+        /* Pairs are kept on the listed order, so swapped pairs end up with
+         * the same key */
+        if (pEntry->swap) {
+            return _gatherPair(pNode2, pNode1, index2 * CI_MAX + index1);
+        }
+        return _gatherPair(pNode1, pNode2, index1 * CI_MAX + index2);
+    }
+#if defined(DEBUG)
+    pairCount[index1][index2]++;
+#endif
+    return pEntry->handler(pNodes[pEntry->swap], pNodes[!pEntry->swap]);
+}
+
+/** Order pairs by their types and then by the order they were gathered */
+static int _comparePairs(const void *pA, const void *pB) {
+    const collisionPair *pPair1, *pPair2;
+
+    pPair1 = (const collisionPair*)pA;
+    pPair2 = (const collisionPair*)pB;
+    if (pPair1->key != pPair2->key) {
+        return pPair1->key - pPair2->key;
+    }
+    return pPair1->order - pPair2->order;
+}
+
+/**
+ * Resolve every pair gathered (on batch mode) since the last call. Pairs are
+ * sorted by their types (and then by the order they were found) and each
+ * handler is called for all of its pairs at once. skipCollision has no effect
+ * on gathered pairs. Must be called before resetCollision.
+ */
+err resolveCollision() {
+    int i;
+    err erv;
+
+    /* Gather every pair of dynamic objects (reported just like the other
+     * broadphases, with the object added last first) */
+    if (collision.broadphase == BP_BANDS) {
+        erv = findBandPairs(&collision.bands);
+        ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+        i = 0;
+        while (i < collision.bands.numPairs) {
+            collisionNode nodes[2];
+
+            int didHit;
+
+            _loadNode(&nodes[0], collision.bands.pPairs[i].id2);
+            _loadNode(&nodes[1], collision.bands.pPairs[i].id1);
+            erv = _sweepPair(&didHit, &nodes[0], &nodes[1]);
+            ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+            firstQueryPair = numPairs;
+            if (didHit) {
+                erv = _dispatch(&nodes[0], &nodes[1]);
+                ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+            }
+            i++;
+        }
+    }
+
+    qsort(pPairs, numPairs, sizeof(collisionPair), &_comparePairs);
+
+    i = 0;
+    while (i < numPairs) {
+        collisionHandler handler;
+        int key, last;
+
+        /* Resolve every pair of the same types at once */
+        key = pPairs[i].key;
+        handler = dispatch[key / CI_MAX][key % CI_MAX].handler;
+        last = i + 1;
+        while (last < numPairs && pPairs[last].key == key) {
+            last++;
+        }
+#if defined(DEBUG)
+        pairCount[key / CI_MAX][key % CI_MAX] += last - i;
+#endif
+        while (i < last) {
+            erv = handler(&pPairs[i].nodes[0], &pPairs[i].nodes[1]);
+            ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+            i++;
+        }
+    }
+
+    erv = ERR_OK;
+__ret:
+    numPairs = 0;
+    numGathered = 0;
+    firstQueryPair = 0;
+
+    return erv;
+}
+
+/** Release the buffer of gathered pairs (and of swept tiles) */
+void cleanCollisionPairs() {
+    free(pHits);
+    pHits = 0;
+    maxHits = 0;
+    free(pPairs);
+    pPairs = 0;
+    numPairs = 0;
+    numGathered = 0;
+    maxPairs = 0;
+    firstQueryPair = 0;
+}
+
+/** Order tiles by their time of impact and then by the order they were found */
+static int _compareHits(const void *pA, const void *pB) {
+    const collisionHit *pHit1, *pHit2;
+
+    pHit1 = (const collisionHit*)pA;
+    pHit2 = (const collisionHit*)pB;
+    if (pHit1->tile.toi < pHit2->tile.toi) {
+        return -1;
+    }
+    else if (pHit1->tile.toi > pHit2->tile.toi) {
+        return 1;
+    }
+    return pHit1->order - pHit2->order;
+}
+
+/**
+ * Add a run of tiles hit by a swept object to the hit buffer
+ *
+ * @param  [ in]pTile   The run of tiles (with its time of impact)
+ * @param  [ in]numHits How many tiles were hit so far
+ */
+static err _addHit(collisionNode *pTile, int numHits) {
+    if (numHits >= maxHits) {
+        collisionHit *pTmp;
+        int max;
+
+        max = maxHits * 2;
+        if (max == 0) {
+            max = PAIR_BUFFER_INITIAL_LEN;
+        }
+        pTmp = realloc(pHits, sizeof(collisionHit) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pHits = pTmp;
+        maxHits = max;
+    }
+
+    pHits[numHits].order = numHits;
+    pHits[numHits].tile = *pTile;
+
+    return ERR_OK;
+}
+
+/**
+ * Collide an object against every tile that it touches on the static world.
+ * Each run of tiles of the same type (on a row) is reported as a single pair.
+ *
+ * Swept objects are tested against every run within the area covered by their
+ * movement, and the runs that they hit are reported in the order they were
+ * hit (instead of row by row).
+ *
+ * @param  [ in]pNode The object
+ * @param  [ in]mask  Layers that may interact with the object
+ */
+static err _collideTiles(collisionNode *pNode, unsigned int mask) {
+    int x, y, width, height, dx, dy, firstX, lastX, lastY, tileY, numHits;
+    err erv;
+
+    erv = _getMovement(&x, &y, &width, &height, &dx, &dy, pNode);
+    ASSERT(erv == ERR_OK, erv);
+
+    /* Only the cells touched by the object (along its movement) are ever
+     * visited */
+    firstX = ((dx < 0) ? x + dx : x) >> STATIC_TILE_BITS;
+    lastX = (((dx > 0) ? x + dx : x) + width - 1) >> STATIC_TILE_BITS;
+    tileY = ((dy < 0) ? y + dy : y) >> STATIC_TILE_BITS;
+    lastY = (((dy > 0) ? y + dy : y) + height - 1) >> STATIC_TILE_BITS;
+    if (firstX < 0) {
+        firstX = 0;
+    }
+    if (lastX >= collision.widthInTiles) {
+        lastX = collision.widthInTiles - 1;
+    }
+    if (tileY < 0) {
+        tileY = 0;
+    }
+    if (lastY >= collision.heightInTiles) {
+        lastY = collision.heightInTiles - 1;
+    }
+
+    collision.skip = 0;
+    numHits = 0;
+    while (tileY <= lastY) {
+        const int *pRow;
+        int tileX;
+
+        pRow = collision.pTiles + tileY * collision.widthInTiles;
+        tileX = firstX;
+        while (tileX <= lastX) {
+            collisionNode tile;
+            int type, start;
+
+            type = 0;
+            if ((unsigned)pRow[tileX] < (unsigned)collision.numTileTypes) {
+                type = collision.pTileTypes[pRow[tileX]];
+            }
+            if (type == 0 || !(mask & getCollisionLayer(type))) {
+                tileX++;
+                continue;
+            }
+
+            /* Merge every following tile of the same type */
+            start = tileX;
+            while (tileX < lastX
+                    && (unsigned)pRow[tileX + 1]
+                        < (unsigned)collision.numTileTypes
+                    && collision.pTileTypes[pRow[tileX + 1]] == type) {
+                tileX++;
+            }
+
+            tile.pObject = 0;
+            tile.pSprite = 0;
+            tile.pChild = 0;
+            tile.type = type;
+            tile.x = start << STATIC_TILE_BITS;
+            tile.y = tileY << STATIC_TILE_BITS;
+            tile.width = (tileX - start + 1) << STATIC_TILE_BITS;
+            tile.height = 1 << STATIC_TILE_BITS;
+            tile.id = -1;
+            tile.toi = 0.0;
+            tileX++;
+
+            if (dx != 0 || dy != 0) {
+                /* Only keep the runs actually hit, to be sorted later */
+                if (sweepAabb(&tile.toi, x, y, width, height, dx, dy, tile.x
+                        , tile.y, tile.width, tile.height)) {
+                    erv = _addHit(&tile, numHits);
+                    ASSERT(erv == ERR_OK, erv);
+                    numHits++;
+                }
+                continue;
+            }
+
+            pNode->toi = 0.0;
+            erv = _dispatch(pNode, &tile);
+            ASSERT(erv == ERR_OK, erv);
+            if (collision.skip) {
+                return ERR_OK;
+            }
+        }
+        tileY++;
+    }
+
+    if (numHits > 0) {
+        int i;
+
+        qsort(pHits, numHits, sizeof(collisionHit), &_compareHits);
+        i = 0;
+        while (i < numHits && !collision.skip) {
+            pNode->toi = pHits[i].tile.toi;
+            erv = _dispatch(pNode, &pHits[i].tile);
+            ASSERT(erv == ERR_OK, erv);
+            i++;
+        }
+    }
+
+    return ERR_OK;
+}
+
 /**
  * Continue handling collision.
- * 
+ *
  * Different from the other functions on this module, this one is declared on
  * src/collision.c (instead of src/base/collision.c). This decision was made
  * because this function shall be modified for each game.
  *
- * @param  [ in]pQt The current quadtree
+ * @param  [ in]pQt The current quadtree (or 0, for collision.hash or
+ *                  collision.incremental)
  */
 err doCollide(gfmQuadtreeRoot *pQt) {
     /** GFraMe return value */
     gfmRV rv;
+    err erv;
 
     /* Continue colliding until the quadtree finishes (or collision is
      * skipped) */
     rv = GFMRV_QUADTREE_OVERLAPED;
     collision.skip = 0;
     while (rv != GFMRV_QUADTREE_DONE && !collision.skip) {
-        collisionNode node1, node2;
-        int isFirstCase;
-        int fallthrough;
+        collisionNode nodes[2];
+        int didHit;
 
-        /* Retrieve the two overlaping objects and their types */
-        rv = gfmQuadtree_getOverlaping(&node1.pObject, &node2.pObject
-                , pQt);
-        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
-        _getSubtype(&node1);
-        _getSubtype(&node2);
-
-        /* Merge both types into a single one, so it's easier to compare */
-        isFirstCase = 0;
-        fallthrough = 0;
-        switch (MERGE_TYPES(node1.type, node2.type)) {
-            /* TODO Handle every collision */
-
-            /* On Linux, a SIGINT is raised any time a unhandled collision
-             * happens. When debugging, GDB will stop here and allow the user to
-             * check which types weren't handled */
-            default: {
-#  if defined(DEBUG) && !(defined(__WIN32) || defined(__WIN32__))
-                /* Unfiltered collision, do something about it */
-                raise(SIGINT);
-                rv = GFMRV_INTERNAL_ERROR;
-#  endif
+        /* Retrieve the two overlaping objects and their types. The hashes
+         * report indexes into the node cache (except for sleeping objects,
+         * which weren't collided on this frame) */
+        if (pQt) {
+            rv = gfmQuadtree_getOverlaping(&nodes[0].pObject
+                    , &nodes[1].pObject, pQt);
+            ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+            _resolveNode(&nodes[0]);
+            _resolveNode(&nodes[1]);
+        }
+        else {
+            int id1, id2;
+
+            if (collision.broadphase == BP_INCREMENTAL) {
+                getIncrementalOverlap(&id1, &id2, &nodes[1].pObject
+                        , &collision.incremental);
             }
-        } /* switch (MERGE_TYPES(node1.type, node2.type)) */
-        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+            else {
+                getSpatialHashOverlap(&id1, &id2, &collision.hash);
+            }
+            _loadNode(&nodes[0], id1);
+            if (id2 != -1) {
+                _loadNode(&nodes[1], id2);
+            }
+            else {
+                nodes[1].pSprite = 0;
+                nodes[1].id = -1;
+                _getSubtype(&nodes[1]);
+            }
+        }
+
+        /* Look up the handler and call it with the objects on the listed
+         * order (if they actually collided, in case any was swept) */
+        erv = _sweepPair(&didHit, &nodes[0], &nodes[1]);
+        ASSERT(erv == ERR_OK, erv);
+        if (didHit) {
+            erv = _dispatch(&nodes[0], &nodes[1]);
+            ASSERT(erv == ERR_OK, erv);
+        }
 
         /** Update the quadtree (so any other collision is detected) */
-        rv = gfmQuadtree_continue(pQt);
+        if (pQt) {
+            rv = gfmQuadtree_continue(pQt);
+            ASSERT(rv == GFMRV_QUADTREE_OVERLAPED || rv == GFMRV_QUADTREE_DONE,
+                    ERR_GFMERR);
+        }
+        else if (collision.broadphase == BP_INCREMENTAL
+                && continueIncrementalHash(&collision.incremental)) {
+            rv = GFMRV_QUADTREE_OVERLAPED;
+        }
+        else if (collision.broadphase != BP_INCREMENTAL
+                && continueSpatialHash(&collision.hash)) {
+            rv = GFMRV_QUADTREE_OVERLAPED;
+        }
+        else {
+            rv = GFMRV_QUADTREE_DONE;
+        }
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Add a proxy for a swept object, covering its whole movement
+ *
+ * @param  [out]ppProxy The object that should be added to the broadphases
+ *                      (the object itself, if it didn't move)
+ * @param  [ in]id      Index of the object on the node cache
+ * @param  [ in]fromX   Horizontal position of the object at the start
+ * @param  [ in]fromY   Vertical position of the object at the start
+ */
+static err _addProxy(gfmObject **ppProxy, int id, int fromX, int fromY) {
+    collisionProxies *pProxies;
+    gfmObject *pObject;
+    void *pChild;
+    int x, y, width, height, left, top, proxy, type;
+    gfmRV rv;
+
+    pObject = collision.nodes.ppObjects[id];
+    *ppProxy = pObject;
+    rv = gfmObject_getPosition(&x, &y, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    if (x == fromX && y == fromY) {
+        return ERR_OK;
+    }
+    rv = gfmObject_getDimensions(&width, &height, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+
+    pProxies = &collision.proxies;
+    if (pProxies->numProxies >= pProxies->maxProxies) {
+        void *pTmp;
+        int max;
+
+        max = pProxies->maxProxies * 2;
+        if (max == 0) {
+            max = PROXY_INITIAL_LEN;
+        }
+        pTmp = realloc(pProxies->pIds, sizeof(int) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pProxies->pIds = pTmp;
+        pTmp = realloc(pProxies->pFromX, sizeof(int) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pProxies->pFromX = pTmp;
+        pTmp = realloc(pProxies->pFromY, sizeof(int) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pProxies->pFromY = pTmp;
+        pTmp = realloc(pProxies->ppObjects, sizeof(gfmObject*) * max);
+        ASSERT(pTmp, ERR_MALLOC);
+        pProxies->ppObjects = pTmp;
+        /* Proxies are counted as they are allocated, so they may be
+         * released even if this fails midway */
+        while (pProxies->maxProxies < max) {
+            rv = gfmObject_getNew(&pProxies->ppObjects[pProxies->maxProxies]);
+            ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+            pProxies->maxProxies++;
+        }
+    }
+
+    left = (x < fromX) ? x : fromX;
+    top = (y < fromY) ? y : fromY;
+    rv = gfmObject_getChild(&pChild, &type, pObject);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+
+    proxy = pProxies->numProxies;
+    rv = gfmObject_init(pProxies->ppObjects[proxy], left, top
+            , abs(x - fromX) + width, abs(y - fromY) + height, pChild, type);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    pProxies->pIds[proxy] = id;
+    pProxies->pFromX[proxy] = fromX;
+    pProxies->pFromY[proxy] = fromY;
+    pProxies->numProxies++;
+    collision.nodes.pProxies[id] = proxy;
+    *ppProxy = pProxies->ppObjects[proxy];
+
+    return ERR_OK;
+}
+
+/**
+ * Collide an object against the static world and the dynamic broadphase and
+ * add it to the latter.
+ *
+ * Broadphases without any layer that may interact with the object aren't even
+ * traversed. Objects that can't interact with anything aren't added at all.
+ * The object is resolved (into its sprite, child and type) only once, and
+ * kept on collision.nodes for the rest of the frame. Swept objects are added
+ * through a proxy.
+ *
+ * @param  [ in]pObject The object
+ * @param  [ in]isSwept Whether the object should be swept
+ * @param  [ in]fromX   Horizontal position of the object at the start (only
+ *                      used if swept)
+ * @param  [ in]fromY   Vertical position of the object at the start (only
+ *                      used if swept)
+ */
+static err _collideObject(gfmObject *pObject, int isSwept, int fromX
+        , int fromY) {
+    collisionNode node;
+    collisionIndex index;
+    gfmObject *pAdded;
+    unsigned int mask;
+    int didOverlap, id;
+    gfmRV rv;
+    err erv;
+
+    node.pObject = pObject;
+    node.pSprite = 0;
+    _getSubtype(&node);
+    index = _getIndex(node.type);
+    mask = collisionMask[index];
+    if (mask == 0) {
+        /* Nothing may interact with it */
+        return ERR_OK;
+    }
+
+    erv = _cacheNode(&id, &node);
+    ASSERT(erv == ERR_OK, erv);
+    node.id = id;
+    collision.nodes.current = id;
+    firstQueryPair = numPairs;
+
+    pAdded = pObject;
+    if (isSwept) {
+        erv = _addProxy(&pAdded, id, fromX, fromY);
+        ASSERT(erv == ERR_OK, erv);
+    }
+
+    /* The static world is only checked against (never modified), by looking
+     * its tiles up directly. There's no static world while no room is loaded
+     * (e.g., while switching rooms) */
+    if ((mask & collision.staticLayers) && collision.pTiles) {
+        erv = _collideTiles(&node, mask);
+        ASSERT(erv == ERR_OK, erv);
+    }
+
+    if (collision.broadphase == BP_BANDS) {
+        /* Pairs are only found by resolveCollision */
+        erv = addBandObject(&collision.bands, pAdded, id, 1u << index
+                , mask);
+        ASSERT(erv == ERR_OK, erv);
+    }
+    else if (collision.broadphase == BP_INCREMENTAL) {
+        /* Sleeping objects may be on any layer, so it's always collided */
+        erv = collideIncrementalHash(&didOverlap, &collision.incremental
+                , pAdded, id, 1u << index, mask);
+        ASSERT(erv == ERR_OK, erv);
+        if (didOverlap) {
+            erv = doCollide(0);
+            ASSERT(erv == ERR_OK, erv);
+        }
+    }
+    else if (collision.broadphase == BP_SPATIALHASH
+            && (mask & collision.layers)) {
+        erv = collideSpatialHash(&didOverlap, &collision.hash, pAdded, id
+                , 1u << index, mask);
+        ASSERT(erv == ERR_OK, erv);
+        if (didOverlap) {
+            erv = doCollide(0);
+            ASSERT(erv == ERR_OK, erv);
+        }
+    }
+    else if (collision.broadphase == BP_SPATIALHASH) {
+        erv = populateSpatialHash(&collision.hash, pAdded, id, 1u << index
+                , mask);
+        ASSERT(erv == ERR_OK, erv);
+    }
+    else if (mask & collision.layers) {
+        rv = gfmQuadtree_collideObject(collision.pQt, pAdded);
         ASSERT(rv == GFMRV_QUADTREE_OVERLAPED || rv == GFMRV_QUADTREE_DONE,
                 ERR_GFMERR);
+        if (rv == GFMRV_QUADTREE_OVERLAPED) {
+            erv = doCollide(collision.pQt);
+            ASSERT(erv == ERR_OK, erv);
+        }
+    }
+    else {
+        /* Nothing on the broadphase may interact with it, but objects added
+         * later may */
+        rv = gfmQuadtree_populateObject(collision.pQt, pAdded);
+        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
     }
+    if (collision.batch) {
+        _dropRepeatedPairs();
+    }
+    collision.layers |= 1u << index;
+    collision.nodes.current = -1;
 
     return ERR_OK;
 }
 
+/**
+ * Collide an object against the static world and the dynamic broadphase and
+ * add it to the latter. Pairs that never interact (i.e., handled by
+ * ignoreCollision) are pruned before reaching the broadphase.
+ *
+ * @param  [ in]pObject The object
+ */
+err collideObject(gfmObject *pObject) {
+    double start;
+    err erv;
+
+    start = (collision.isTimed ? getProfilerTime() : 0.0);
+    PROFILE_BEGIN(collide);
+    erv = _collideObject(pObject, 0, 0, 0);
+    PROFILE_END(collide);
+    if (collision.isTimed) {
+        collision.collideTime += getProfilerTime() - start;
+    }
+
+    return erv;
+}
+
+/**
+ * Collide an object that moved from (fromX, fromY) to its current position
+ * on this step, so it's stopped by anything along the way (instead of going
+ * through it). The handlers receive the time of impact of each pair, and the
+ * static world is reported in the order it was hit. Other objects are
+ * expected to move along a line as well (if swept) or to stand still.
+ *
+ * @param  [ in]pObject The object (at its position at the end of the step)
+ * @param  [ in]fromX   Horizontal position of the object at the start
+ * @param  [ in]fromY   Vertical position of the object at the start
+ */
+err collideSweptObject(gfmObject *pObject, int fromX, int fromY) {
+    double start;
+    err erv;
+
+    start = (collision.isTimed ? getProfilerTime() : 0.0);
+    PROFILE_BEGIN(collide);
+    erv = _collideObject(pObject, 1, fromX, fromY);
+    PROFILE_END(collide);
+    if (collision.isTimed) {
+        collision.collideTime += getProfilerTime() - start;
+    }
+
+    return erv;
+}
+
+/**
+ * Put an object to sleep, so it doesn't have to be collided (nor even moved
+ * within the broadphase) anymore. Awake objects are still collided against
+ * it. Only used by BP_INCREMENTAL.
+ *
+ * @param  [ in]pObject The object
+ */
+err sleepObject(gfmObject *pObject) {
+    collisionNode node;
+    collisionIndex index;
+
+    if (collision.broadphase != BP_INCREMENTAL) {
+        return ERR_OK;
+    }
+
+    node.pObject = pObject;
+    node.pSprite = 0;
+    _getSubtype(&node);
+    index = _getIndex(node.type);
+    if (collisionMask[index] == 0) {
+        /* Nothing may interact with it */
+        return ERR_OK;
+    }
+
+    return sleepIncrementalObject(&collision.incremental, pObject, 1u << index
+            , collisionMask[index]);
+}
+
+/**
+ * Wake a sleeping object up. It must be collided on every frame (or be put
+ * to sleep again), or it's removed from the broadphase. Only used by
+ * BP_INCREMENTAL.
+ *
+ * @param  [ in]pObject The object
+ */
+err wakeObject(gfmObject *pObject) {
+    if (collision.broadphase != BP_INCREMENTAL) {
+        return ERR_OK;
+    }
+
+    return wakeIncrementalObject(&collision.incremental, pObject);
+}
+
+/**
+ * Remove an object (e.g., a sleeping one that was destroyed) from the
+ * broadphase. Only used by BP_INCREMENTAL.
+ *
+ * @param  [ in]pObject The object
+ */
+void removeObject(gfmObject *pObject) {
+    if (collision.broadphase == BP_INCREMENTAL) {
+        removeIncrementalObject(&collision.incremental, pObject);
+    }
+}
+
@@ -6,145 +6,478 @@
 #include <base/collision.h>
 #include <base/error.h>
 #include <base/game.h>
-#include <base/gfx.h>
+#include <conf/room_list.h>
 #include <conf/type.h>
-#include <GFraMe/gfmQuadtree.h>
-#include <GFraMe/gfmTilemap.h>
+#include <GFraMe/gframe.h>
 #include <ld37/level.h>
+#include <ld37/levelFile.h>
+#include <ld37/mirror.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if !(defined(__WIN32) || defined(__WIN32__))
+#  include <pthread.h>
+#endif
+
 /* == Global stuff ========================================================== */
 
-/** The game's main/only tilemap */
-gfmTilemap *pMap = 0;
-
-/** Single buffer that point to every data */
-static int *pDataBuffer = 0;
-/** The map's width in tiles */
-static int widthInTiles = 0;
-/** The map's height in tiles */
-static int heightInTiles = 0;
-/** The original tilemap data, as loaded from the file */
-static int *pBaseData = 0;
-/** The tilemap data horizontally mirrored */
-static int *pHorizontalMirrorData = 0;
-/** The tilemap data vertically mirrored */
-static int *pVerticalMirrorData = 0;
-/** The tilemap data mirrored in both direction */
-static int *pBothMirrorData = 0;
-
-/* == Tilemap types dictionary ============================================== */
-
-/* This enumeration is required to ensured no unnecessary empty space appears on
- * typeValues or typeNames */
-enum {
-    TM_LEFT_CORNER = 0
-  , TM_RIGHT_CORNER
-  , TM_FLOOR
-  , TM_DICT_LEN
+/**
+ * Everything loaded from a room's file. None of this depends on GFraMe, so it
+ * is entirely prepared by the streaming thread.
+ */
+struct stRoomData {
+    /** The level, either mapped from its binary file or, if that's missing,
+     * parsed from its text version */
+    levelFile level;
+    /** The map's width in tiles */
+    int widthInTiles;
+    /** The map's height in tiles */
+    int heightInTiles;
+    /** The original tilemap data, as loaded from the file (i.e., the level's
+     * chunks, which may be within its mapping) */
+    const levelTiles *pTiles;
+    /** Type of each tile (0 if it doesn't collide), indexed by the tile */
+    int *pTypeTable;
+    /** Number of entries in pTypeTable */
+    int typeTableLen;
+    /** The default orientation, expanded into ints (row by row), as that's
+     * what collision and the renderer use. Handed over to the level once the
+     * room is switched to */
+    int *pDefault;
+    /** Which room this is */
+    levelRoom room;
+    /** Result of preparing the room */
+    err prepareErr;
 };
+typedef struct stRoomData roomData;
+
+/** Double buffer of rooms: the current one and the one being preloaded */
+static roomData rooms[2];
+/** The room being played. Only ever accessed from the simulation */
+static roomData *pRoom = &rooms[0];
+/** The room being (or already) preloaded. Owned by the streaming thread while
+ * it's running */
+static roomData *pNextRoom = &rooms[1];
+/** Whether pNextRoom holds a preloaded (or preloading) room */
+static int hasNextRoom = 0;
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+/** Thread preparing pNextRoom */
+static pthread_t streamThread;
+/** Whether streamThread must still be joined */
+static int isStreaming = 0;
+/** Protects isNextReady */
+static pthread_mutex_t streamMutex = PTHREAD_MUTEX_INITIALIZER;
+/** Set by the streaming thread once pNextRoom is prepared */
+static int isNextReady = 0;
+#endif
+
+/** Directory with the game's assets, relative to the binary's directory */
+#define ASSETS_DIR "assets/"
+
+/** Binary level of every room (relative to ASSETS_DIR) */
+static const char *roomBins[] = {
+#define X(name, bin, ...) [LR_##name] = bin,
+    ROOM_LIST
+#undef X
+};
+
+/** Full path to the binary level of every room (built by initLevel) */
+static char *roomBinPaths[LR_MAX];
 
-int typeValues[] = {
-    [TM_LEFT_CORNER] = T_LEFT_CORNER
-  , [TM_RIGHT_CORNER] = T_RIGHT_CORNER
-  , [TM_FLOOR] = T_FLOOR
+/** Text level of every room (relative to ASSETS_DIR, or 0 if there's none) */
+static const char *roomMaps[] = {
+#define X(name, bin, map) [LR_##name] = map,
+    ROOM_LIST
+#undef X
 };
 
-char *typeNames[] = {
-    [TM_LEFT_CORNER] = "left_corner"
-  , [TM_RIGHT_CORNER] = "right_corner"
-  , [TM_FLOOR] = "floor"
+/** Full path to the text level of every room (built by initLevel) */
+static char *roomMapPaths[LR_MAX];
+
+/**
+ * Everything required to play the level on a given orientation.
+ *
+ * Each orientation is generated straight into its own buffer, which is what
+ * the collision queries, so switching orientations never copies any tile.
+ * Tilemaps are only created by whoever draws the level (see getLevelData), so
+ * the level never touches GFraMe and may be simulated from any thread.
+ */
+struct stLevelEntry {
+    /** The orientation's tiles, row by row (0 if it wasn't generated) */
+    int *pData;
+    /** When it was last loaded (compared against useCount) */
+    unsigned int lastUse;
 };
+typedef struct stLevelEntry levelEntry;
+
+/** Every orientation, generated (and kept) from its first use */
+static levelEntry entries[LO_MAX];
+/** The orientation currently loaded */
+static levelOrientation curOrientation = LO_DEFAULT;
+/** Incremented on every loadLevel, to find the least recently used entry (and
+ * so the renderer knows when the tiles changed) */
+static unsigned int useCount = 0;
+/** Maximum number of bytes used by cached orientations (if negative, it's
+ * sized from the current room's dimensions) */
+static int cacheBudget = LEVEL_CACHE_BUDGET;
+/** Statistics about the orientation cache */
+static levelCacheStats cacheStats;
 
 /* == Functions ============================================================= */
 
+/** Number of bytes used by a cached orientation's data (which may not fit an
+ * int, on big rooms) */
+#define ENTRY_SIZE() \
+    (sizeof(int) * (size_t)pRoom->widthInTiles * (size_t)pRoom->heightInTiles)
+
+/** Release a cached orientation (if it was generated) */
+static void _evictOrientation(levelOrientation orientation) {
+    levelEntry *pEntry;
+
+    pEntry = &entries[orientation];
+    if (pEntry->pData != 0) {
+        cacheStats.usedBytes -= ENTRY_SIZE();
+    }
+    free(pEntry->pData);
+    memset(pEntry, 0x0, sizeof(levelEntry));
+}
+
+/** Retrieve the cache's budget for the current room, in bytes */
+static size_t _getCacheBudget() {
+    if (cacheBudget < 0) {
+        /* Fit every orientation of the room (other than the default one) */
+        return ENTRY_SIZE() * (LO_MAX - 1);
+    }
+    return (size_t)cacheBudget;
+}
+
 /**
- * Modify a tile's orientation
- *
- * @param  [ in]tile        The tile, in its default orientation
- * @param  [ in]orientation The new orientation
+ * Evict the least recently used orientations until the cache fits within the
+ * budget. Neither the current nor the default orientations are ever evicted.
  */
-static inline int _recalculateTile(int tile, levelOrientation orientation);
+static void _fitCacheBudget() {
+    while (cacheStats.usedBytes > _getCacheBudget()) {
+        int i, lru;
+
+        lru = LO_MAX;
+        i = LO_DEFAULT + 1;
+        while (i < LO_MAX) {
+            if (entries[i].pData != 0 && i != (int)curOrientation
+                    && (lru == LO_MAX
+                    || entries[i].lastUse < entries[lru].lastUse)) {
+                lru = i;
+            }
+            i++;
+        }
+        if (lru == LO_MAX) {
+            break;
+        }
 
-/** Initialize the level's static data */
-err initLevel() {
-    int *pData, i;
-    gfmRV rv;
+        _evictOrientation(lru);
+        cacheStats.evictions++;
+    }
+}
 
-    /* Load the base level */
-    rv = gfmTilemap_getNew(&pMap);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
-    rv = gfmTilemap_init(pMap, gfx.pSset8x8, TM_DEF_WIDTH, TM_DEF_HEIGHT
-            , TM_DEF_TILE);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
-    rv = gfmTilemap_loadf(pMap, game.pCtx, TM_DEF_MAP, TM_DEF_MAP_LEN, typeNames
-            , typeValues, TM_DICT_LEN);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+/**
+ * Generate an orientation (other than the default one, which is expanded when
+ * the room is prepared)
+ *
+ * @param  [ in]orientation The orientation
+ */
+static err _buildOrientation(levelOrientation orientation) {
+    levelEntry *pEntry;
 
-    /* Retrieve the tilemap's data so it may be mirrored */
-    rv = gfmTilemap_getData(&pData, pMap);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
-    rv = gfmTilemap_getDimension(&widthInTiles, &heightInTiles, pMap);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
-    widthInTiles /= 8;
-    heightInTiles /= 8;
+    pEntry = &entries[orientation];
+    pEntry->pData = malloc(ENTRY_SIZE());
+    ASSERT(pEntry->pData, ERR_MALLOC);
+    cacheStats.usedBytes += ENTRY_SIZE();
+    mirrorTilemap(pEntry->pData, pRoom->pTiles, orientation);
 
-    /* Alloc enough memory for every map */
-    pDataBuffer = malloc(sizeof(int) * widthInTiles * heightInTiles * 4);
-    ASSERT(pDataBuffer, ERR_MALLOC);
-    pBaseData = pDataBuffer;
-    pHorizontalMirrorData = pDataBuffer + widthInTiles * heightInTiles;
-    pVerticalMirrorData = pDataBuffer + widthInTiles * heightInTiles * 2;
-    pBothMirrorData = pDataBuffer + widthInTiles * heightInTiles * 3;
+    if (cacheStats.usedBytes > cacheStats.peakBytes) {
+        cacheStats.peakBytes = cacheStats.usedBytes;
+    }
+    cacheStats.generated++;
 
-    /* Initialize every map */
-    memcpy(pBaseData, pData, sizeof(int) * widthInTiles * heightInTiles);
+    return ERR_OK;
+}
 
+/**
+ * Retrieve the dimensions of a room's level and build its table of tile types
+ *
+ * @param  [ in]pData The room (with its level loaded)
+ */
+static err _initRoomTypes(roomData *pData) {
+    const int *pTypes;
+    int i, len;
+
+    pData->widthInTiles = pData->level.tiles.widthInTiles;
+    pData->heightInTiles = pData->level.tiles.heightInTiles;
+    pData->pTiles = &pData->level.tiles;
+
+    /* Expand the types into a table, so colliding against a tile is a single
+     * lookup */
+    pTypes = pData->level.pTileTypes;
+    len = 0;
     i = 0;
-    while (i < heightInTiles) {
-        int j = 0;
-        while (j < widthInTiles) {
-            int tile;
-
-            tile = _recalculateTile(pBaseData[j + i * widthInTiles]
-                    , LO_HORIZONTAL_MIRROR);
-            pHorizontalMirrorData[widthInTiles - j - 1 + i * widthInTiles]
-                    = tile;
-
-            tile = _recalculateTile(pBaseData[j + i * widthInTiles]
-                    , LO_VERTICAL_MIRROR);
-            pVerticalMirrorData[j + (heightInTiles - i - 1) * widthInTiles]
-                    = tile;
-            j++;
+    while (i < pData->level.numTileTypes) {
+        if (pTypes[i * 2] >= len) {
+            len = pTypes[i * 2] + 1;
         }
         i++;
     }
+    pData->pTypeTable = calloc(len > 0 ? len : 1, sizeof(int));
+    ASSERT(pData->pTypeTable, ERR_MALLOC);
+    pData->typeTableLen = len;
+    i = 0;
+    while (i < pData->level.numTileTypes) {
+        if (pTypes[i * 2] >= 0) {
+            pData->pTypeTable[pTypes[i * 2]] = pTypes[i * 2 + 1];
+        }
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Load everything required to play a room: its level (mapped from the binary
+ * file or, if that's missing or outdated, parsed from the text one), its table
+ * of tile types and its default orientation. This doesn't touch GFraMe (nor
+ * any global state), so it's run by the streaming thread, leaving nothing but
+ * handing the buffers over for switchRoom.
+ *
+ * @param  [ in]pData The room (with its room field set)
+ */
+static err _prepareRoom(roomData *pData) {
+    err erv;
+
+    /* A missing binary level isn't an error, so don't ASSERT it */
+    erv = openLevelFile(&pData->level, roomBinPaths[pData->room]);
+    if ((erv == ERR_OPENFILE || erv == ERR_BADFILE)
+            && roomMapPaths[pData->room] != 0) {
+        erv = openLevelText(&pData->level, roomMapPaths[pData->room]);
+    }
+    ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+    erv = _initRoomTypes(pData);
+    ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+
+    /* Both copies of the tiles are kept on purpose: the compact chunks are
+     * read to build the other orientations (and to look single tiles up),
+     * while collision and the renderer need plain ints, row by row. The
+     * chunks are only a fraction of the expanded tiles (as they are narrower
+     * and the empty ones are skipped), and expanding them here also faults
+     * in every page of the mapping that's ever read afterward */
+    pData->pDefault = malloc(sizeof(int) * pData->widthInTiles
+            * pData->heightInTiles);
+    ASSERT_TO(pData->pDefault, erv = ERR_MALLOC, __ret);
+    mirrorTilemap(pData->pDefault, pData->pTiles, LO_DEFAULT);
+
+    erv = ERR_OK;
+__ret:
+    pData->prepareErr = erv;
+    return erv;
+}
+
+/** Release everything loaded for a room */
+static void _releaseRoom(roomData *pData) {
+    free(pData->pTypeTable);
+    free(pData->pDefault);
+    closeLevelFile(&pData->level);
+    memset(pData, 0x0, sizeof(roomData));
+}
 
+#if !(defined(__WIN32) || defined(__WIN32__))
+/** Entry point for the streaming thread */
+static void* _streamThread(void *pArg) {
+    _prepareRoom((roomData*)pArg);
+
+    pthread_mutex_lock(&streamMutex);
+    isNextReady = 1;
+    pthread_mutex_unlock(&streamMutex);
+
+    return 0;
+}
+#endif
+
+/** Wait until the room being preloaded (if any) is prepared */
+static void _waitStream() {
+#if !(defined(__WIN32) || defined(__WIN32__))
+    if (isStreaming) {
+        pthread_join(streamThread, 0);
+        isStreaming = 0;
+    }
+#endif
+}
+
+/**
+ * Start playing the current room, from its prepared data. Its default
+ * orientation is simply handed over to the level, so this never blocks.
+ */
+static err _activateRoom() {
+    int i;
+
+    ASSERT(pRoom->prepareErr == ERR_OK, pRoom->prepareErr);
+
+    /* The default orientation is never evicted, nor accounted for */
+    entries[LO_DEFAULT].pData = pRoom->pDefault;
+    pRoom->pDefault = 0;
+
+    /* Objects are only checked against the static world if they may interact
+     * with any of the room's tiles */
+    collision.staticLayers = 0;
     i = 0;
-    while (i < heightInTiles * widthInTiles) {
-        int tile;
+    while (i < pRoom->typeTableLen) {
+        if (pRoom->pTypeTable[i] != 0) {
+            collision.staticLayers |= getCollisionLayer(pRoom->pTypeTable[i]);
+        }
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Release every orientation of the current room, along with any object kept
+ * asleep on it
+ */
+static void _deactivateRoom() {
+    int i;
+
+    free(entries[LO_DEFAULT].pData);
+    collision.pTiles = 0;
+    memset(&entries[LO_DEFAULT], 0x0, sizeof(levelEntry));
+    /* Sleeping objects belong to the room being left (and awake ones are
+     * simply added back as they are collided) */
+    clearIncrementalHash(&collision.incremental);
+
+    i = LO_DEFAULT + 1;
+    while (i < LO_MAX) {
+        _evictOrientation(i);
+        i++;
+    }
+}
+
+/**
+ * Build the full path to an asset (i.e., a file within ASSETS_DIR)
+ *
+ * @param  [out]ppPath   The path (must be free'd)
+ * @param  [ in]pBinPath The binary's directory (not '\0'-terminated)
+ * @param  [ in]len      Length of pBinPath
+ * @param  [ in]pAsset   The asset
+ */
+static err _getAssetPath(char **ppPath, const char *pBinPath, int len
+        , const char *pAsset) {
+    const char *pSep;
+    size_t size;
+
+    pSep = "";
+    if (len > 0 && pBinPath[len - 1] != '/' && pBinPath[len - 1] != '\\') {
+        pSep = "/";
+    }
+
+    size = len + strlen(pSep) + strlen(ASSETS_DIR) + strlen(pAsset) + 1;
+    *ppPath = malloc(size);
+    ASSERT(*ppPath, ERR_MALLOC);
+    snprintf(*ppPath, size, "%.*s%s%s%s", len, pBinPath, pSep, ASSETS_DIR
+            , pAsset);
+
+    return ERR_OK;
+}
+
+/**
+ * Build the full path to every room's levels. They are looked for on the
+ * assets directory next to the binary (just like GFraMe does), instead of on
+ * the working directory.
+ */
+static err _initRoomPaths() {
+    char *pBinPath;
+    int len, i;
+    err erv;
+    gfmRV rv;
+
+    rv = gfm_getBinaryPath(&pBinPath, &len, game.pCtx);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
 
-        tile = _recalculateTile(pBaseData[i], LO_MIRROR_BOTH);
-        pBothMirrorData[heightInTiles * widthInTiles - i - 1] = tile;
+    i = 0;
+    while (i < LR_MAX) {
+        erv = _getAssetPath(&roomBinPaths[i], pBinPath, len, roomBins[i]);
+        ASSERT(erv == ERR_OK, erv);
+        if (roomMaps[i] != 0) {
+            erv = _getAssetPath(&roomMapPaths[i], pBinPath, len, roomMaps[i]);
+            ASSERT(erv == ERR_OK, erv);
+        }
         i++;
     }
 
     return ERR_OK;
 }
 
+/** Initialize the level's static data and load the first room */
+err initLevel() {
+    err erv;
+
+    initMirrorTables();
+    erv = _initRoomPaths();
+    ASSERT(erv == ERR_OK, erv);
+
+    /* The first room is loaded synchronously, as there's nothing else to do
+     * in the meantime */
+    pRoom->room = (levelRoom)0;
+    erv = _prepareRoom(pRoom);
+    ASSERT(erv == ERR_OK, erv);
+    erv = _activateRoom();
+    ASSERT(erv == ERR_OK, erv);
+    curOrientation = LO_DEFAULT;
+
+    return ERR_OK;
+}
+
 /** Release all static data */
 void cleanLevel() {
-    gfmTilemap_free(&pMap);
-    free(pDataBuffer);
+    int i;
+
+    _waitStream();
+    _deactivateRoom();
 
-    widthInTiles = 0;
-    heightInTiles = 0;
+    _releaseRoom(pRoom);
+    _releaseRoom(pNextRoom);
+    hasNextRoom = 0;
+#if !(defined(__WIN32) || defined(__WIN32__))
+    isNextReady = 0;
+#endif
 
-    pBaseData = 0;
-    pHorizontalMirrorData = 0;
-    pVerticalMirrorData = 0;
-    pBothMirrorData = 0;
+    i = 0;
+    while (i < LR_MAX) {
+        free(roomBinPaths[i]);
+        free(roomMapPaths[i]);
+        roomBinPaths[i] = 0;
+        roomMapPaths[i] = 0;
+        i++;
+    }
+}
+
+/**
+ * Set the maximum number of bytes used by cached orientations. The current
+ * orientation is always kept, but every other is evicted (least recently used
+ * first) until the cache fits the budget.
+ *
+ * @param  [ in]bytes The new budget (if negative, it's sized from each room's
+ *                    dimensions, so all of its orientations fit)
+ */
+void setLevelCacheBudget(int bytes) {
+    cacheBudget = bytes;
+    _fitCacheBudget();
+}
+
+/**
+ * Retrieve the orientation cache's counters
+ *
+ * @param  [out]pStats The counters
+ */
+void getLevelCacheStats(levelCacheStats *pStats) {
+    *pStats = cacheStats;
 }
 
 /**
@@ -153,96 +486,207 @@ void cleanLevel() {
  * @param  [ in]orientation Bitmask of the level's orientation
  */
 err loadLevel(levelOrientation orientation) {
-    int *pData;
-    gfmRV rv;
-
-    /** Load the new orientation into the map */
-    rv = gfmTilemap_getData(&pData, pMap);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
-    switch (orientation) {
-        case LO_DEFAULT:
-            memcpy(pData, pBaseData
-                    , sizeof(int) * widthInTiles * heightInTiles);
-            break;
-        case LO_HORIZONTAL_MIRROR:
-            memcpy(pData, pHorizontalMirrorData
-                    , sizeof(int) * widthInTiles * heightInTiles);
-            break;
-        case LO_VERTICAL_MIRROR:
-            memcpy(pData, pVerticalMirrorData
-                    , sizeof(int) * widthInTiles * heightInTiles);
-            break;
-        case LO_MIRROR_BOTH:
-            memcpy(pData, pBothMirrorData
-                    , sizeof(int) * widthInTiles * heightInTiles);
-            break;
-        default:
-            ASSERT(0, ERR_ARGUMENTBAD);
+    levelEntry *pEntry;
+    err erv;
+
+    ASSERT(orientation >= LO_DEFAULT && orientation < LO_MAX, ERR_ARGUMENTBAD);
+    useCount++;
+
+    /* Build the orientation on its first use (or if it was evicted). After
+     * that, switching orientations is simply a matter of switching pointers */
+    pEntry = &entries[orientation];
+    if (pEntry->pData == 0) {
+        ASSERT(orientation != LO_DEFAULT, ERR_ARGUMENTBAD);
+        cacheStats.misses++;
+        erv = _buildOrientation(orientation);
+        ASSERT(erv == ERR_OK, erv);
+    }
+    else if (orientation != LO_DEFAULT) {
+        cacheStats.hits++;
     }
 
-    rv = gfmTilemap_recacheAnimations(pMap);
-    ASSERT(rv == GFMRV_OK || rv == GFMRV_TILEMAP_NO_TILEANIM, ERR_GFMERR);
-    rv = gfmTilemap_recalculateAreas(pMap);
-    ASSERT(rv == GFMRV_OK || rv == GFMRV_TILEMAP_NO_TILETYPE, ERR_GFMERR);
+    pEntry->lastUse = useCount;
+    curOrientation = orientation;
 
-    rv = gfmQuadtree_initRoot(collision.pStaticQt, -8/*x*/, -8/*y*/
-            , (widthInTiles + 2) * 8, (heightInTiles + 2) * 8, 8/*depth*/
-            , 16/*nodes*/);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    /* Collide straight against the orientation's tiles */
+    collision.pTiles = pEntry->pData;
+    getLevelDimensions(&collision.widthInTiles, &collision.heightInTiles
+            , orientation);
+    collision.pTileTypes = pRoom->pTypeTable;
+    collision.numTileTypes = pRoom->typeTableLen;
 
-    rv = gfmQuadtree_setStatic(collision.pStaticQt);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    _fitCacheBudget();
 
-    rv = gfmQuadtree_populateTilemap(collision.pStaticQt, pMap);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    return ERR_OK;
+}
+
+/**
+ * Start loading a room on the background. Its file is read (or parsed), its
+ * tile types and its default orientation are expanded on a worker thread, so
+ * switching to it afterward only has to swap some pointers. If another room
+ * was being preloaded, this waits for it to finish (and discards it).
+ *
+ * @param  [ in]room The room
+ */
+err preloadRoom(levelRoom room) {
+    ASSERT(room >= 0 && room < LR_MAX, ERR_ARGUMENTBAD);
+
+    if ((hasNextRoom && pNextRoom->room == room) || pRoom->room == room) {
+        return ERR_OK;
+    }
+
+    /* Discard whichever room was previously preloaded */
+    _waitStream();
+    _releaseRoom(pNextRoom);
+    pNextRoom->room = room;
+    hasNextRoom = 1;
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+    isNextReady = 0;
+    if (pthread_create(&streamThread, 0, _streamThread, pNextRoom) == 0) {
+        isStreaming = 1;
+        return ERR_OK;
+    }
+#endif
+    /* The thread couldn't be started (or isn't supported), so simply prepare
+     * the room right away */
+    _prepareRoom(pNextRoom);
+#if !(defined(__WIN32) || defined(__WIN32__))
+    isNextReady = 1;
+#endif
 
     return ERR_OK;
 }
 
 /**
- * Modify a tile's orientation
+ * Check whether a room may be switched to without waiting for it to load
  *
- * @param  [ in]tile        The tile, in its default orientation
- * @param  [ in]orientation The new orientation
- */
-static inline int _recalculateTile(int tile, levelOrientation orientation) {
-    switch (tile) {
-        case 64: /* top left */
-            if (orientation == LO_HORIZONTAL_MIRROR)    return 66;
-            else if (orientation == LO_VERTICAL_MIRROR) return 96;
-            else if (orientation == LO_MIRROR_BOTH)     return 98;
-            break;
-        case 65: /* top */
-            if (orientation & LO_VERTICAL_MIRROR) return 97;
-            break;
-        case 66: /* top right */
-            if (orientation == LO_HORIZONTAL_MIRROR)    return 64;
-            else if (orientation == LO_VERTICAL_MIRROR) return 98;
-            else if (orientation == LO_MIRROR_BOTH)     return 96;
-            break;
-        case 80: /* left */
-            if (orientation & LO_HORIZONTAL_MIRROR) return 82;
-            break;
-        case 81: /* center */
-            break;
-        case 82: /* right */
-            if (orientation & LO_HORIZONTAL_MIRROR) return 80;
-            break;
-        case 96: /* bottom left */
-            if (orientation == LO_HORIZONTAL_MIRROR)    return 98;
-            else if (orientation == LO_VERTICAL_MIRROR) return 64;
-            else if (orientation == LO_MIRROR_BOTH)     return 66;
-            break;
-        case 97: /* bottom */
-            if (orientation & LO_VERTICAL_MIRROR) return 65;
-            break;
-        case 98: /* bottom right */
-            if (orientation == LO_HORIZONTAL_MIRROR)    return 96;
-            else if (orientation == LO_VERTICAL_MIRROR) return 66;
-            else if (orientation == LO_MIRROR_BOTH)     return 64;
-            break;
-        default: return tile;
+ * @param  [ in]room The room
+ */
+int isRoomReady(levelRoom room) {
+    int isReady;
+
+    if (pRoom->room == room) {
+        return 1;
+    }
+    else if (!hasNextRoom || pNextRoom->room != room) {
+        return 0;
+    }
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+    pthread_mutex_lock(&streamMutex);
+    isReady = isNextReady;
+    pthread_mutex_unlock(&streamMutex);
+#else
+    isReady = 1;
+#endif
+
+    return isReady;
+}
+
+/**
+ * Switch to another room, keeping the current orientation. If the room wasn't
+ * preloaded, it's loaded right away (blocking the caller). If it couldn't be
+ * loaded, the current room is kept.
+ *
+ * @param  [ in]room The room
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE, ERR_MALLOC, ERR_ARGUMENTBAD
+ */
+err switchRoom(levelRoom room) {
+    roomData *pTmp;
+    err erv;
+
+    ASSERT(room >= 0 && room < LR_MAX, ERR_ARGUMENTBAD);
+    if (pRoom->room == room) {
+        return ERR_OK;
+    }
+
+    /* Make sure the room was prepared (this only blocks if it's still being
+     * loaded or if it was never requested) */
+    erv = preloadRoom(room);
+    ASSERT(erv == ERR_OK, erv);
+    _waitStream();
+
+    /* A room that couldn't be loaded is discarded, so the current one is kept
+     * playable (and the room may be requested again). Note that a missing
+     * file isn't ASSERT'ed, as it may be handled by the caller */
+    erv = pNextRoom->prepareErr;
+    if (erv != ERR_OK) {
+        _releaseRoom(pNextRoom);
+        hasNextRoom = 0;
+        return erv;
+    }
+
+    /* Swap the buffers, so the previous room may be reused for the next
+     * preload */
+    _deactivateRoom();
+    pTmp = pRoom;
+    pRoom = pNextRoom;
+    pNextRoom = pTmp;
+    _releaseRoom(pNextRoom);
+    hasNextRoom = 0;
+
+    erv = _activateRoom();
+    ASSERT(erv == ERR_OK, erv);
+
+    return loadLevel(curOrientation);
+}
+
+/**
+ * Retrieve the current room's dimensions on a given orientation
+ *
+ * @param  [out]pWidth      The width in tiles
+ * @param  [out]pHeight     The height in tiles
+ * @param  [ in]orientation The orientation
+ */
+void getLevelDimensions(int *pWidth, int *pHeight
+        , levelOrientation orientation) {
+    if (orientation & LO_TRANSPOSE) {
+        *pWidth = pRoom->heightInTiles;
+        *pHeight = pRoom->widthInTiles;
+    }
+    else {
+        *pWidth = pRoom->widthInTiles;
+        *pHeight = pRoom->heightInTiles;
     }
-    return tile;
 }
 
+/**
+ * Retrieve a tile of the current room on a given orientation. The tile is read
+ * straight from the room's data, so the orientation doesn't have to be loaded
+ * (nor generated).
+ *
+ * @param  [ in]x           Horizontal position, in tiles, on the orientation
+ * @param  [ in]y           Vertical position, in tiles, on the orientation
+ * @param  [ in]orientation The orientation
+ * @return                  The tile (or TM_DEF_TILE, if out of bounds)
+ */
+int getLevelTile(int x, int y, levelOrientation orientation) {
+    int width, height;
+
+    getLevelDimensions(&width, &height, orientation);
+    if (x < 0 || y < 0 || x >= width || y >= height || !pRoom->pTiles) {
+        return TM_DEF_TILE;
+    }
+
+    unmirrorPosition(&x, &y, x, y, pRoom->widthInTiles, pRoom->heightInTiles
+            , orientation);
+    return mirrorTile(readLevelTileAt(pRoom->pTiles, x, y), orientation);
+}
+
+/**
+ * Retrieve the current room's tiles on the current orientation, row by row.
+ * The level doesn't create any tilemap, so this is what should be drawn. The
+ * tiles are only valid until the next loadLevel or switchRoom.
+ *
+ * @param  [out]ppData  The tiles
+ * @param  [out]pWidth  The width in tiles
+ * @param  [out]pHeight The height in tiles
+ * @return              A counter that changes whenever the tiles do
+ */
+unsigned int getLevelData(const int **ppData, int *pWidth, int *pHeight) {
+    *ppData = entries[curOrientation].pData;
+    getLevelDimensions(pWidth, pHeight, curOrientation);
+
+    return useCount;
+}
@@ -0,0 +1,621 @@
+/**
+ * @file src/ld37/levelFile.c
+ *
+ * Map a binary level (see include/ld37/levelFile.h) into memory, or parse a
+ * text level into the same form.
+ */
+#include <base/error.h>
+#include <conf/tiletype_list.h>
+#include <ld37/levelFile.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <stdlib.h>
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#if defined(__WIN32) || defined(__WIN32__)
+/**
+ * There's no mmap on Windows, so simply read the whole file into a buffer
+ *
+ * @param  [out]ppData The file's content
+ * @param  [out]pSize  The file's size
+ * @param  [ in]pPath  Path to the file
+ */
+static err _mapFile(void **ppData, size_t *pSize, const char *pPath) {
+    FILE *pFp;
+    long size;
+    err erv;
+
+    pFp = fopen(pPath, "rb");
+    if (!pFp) {
+        return ERR_OPENFILE;
+    }
+
+    *ppData = 0;
+    erv = ERR_OPENFILE;
+    if (fseek(pFp, 0, SEEK_END) != 0 || (size = ftell(pFp)) <= 0
+            || fseek(pFp, 0, SEEK_SET) != 0) {
+        goto __ret;
+    }
+
+    *ppData = malloc(size);
+    ASSERT_TO(*ppData, erv = ERR_MALLOC, __ret);
+    if (fread(*ppData, size, 1, pFp) != 1) {
+        goto __ret;
+    }
+    *pSize = (size_t)size;
+
+    erv = ERR_OK;
+__ret:
+    if (erv != ERR_OK) {
+        free(*ppData);
+        *ppData = 0;
+    }
+    fclose(pFp);
+
+    return erv;
+}
+
+/** Release a file read by _mapFile */
+static void _unmapFile(void *pData, size_t size) {
+    free(pData);
+}
+#else
+/**
+ * Map a file into memory. The mapping is private, so the tiles may be modified
+ * in memory without touching the file, and it's populated as it's created.
+ *
+ * @param  [out]ppData The file's content
+ * @param  [out]pSize  The file's size
+ * @param  [ in]pPath  Path to the file
+ */
+static err _mapFile(void **ppData, size_t *pSize, const char *pPath) {
+    struct stat st;
+    int flags;
+    int fd;
+    err erv;
+
+    /* Note that a missing file is expected (the text map is used instead), so
+     * ASSERT isn't used on this function */
+    fd = open(pPath, O_RDONLY);
+    if (fd < 0) {
+        return ERR_OPENFILE;
+    }
+
+    erv = ERR_OPENFILE;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        goto __ret;
+    }
+
+    /* Fault every page in right away, so whoever maps the file (i.e., the
+     * streaming thread) is the one that waits for the disk */
+    flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    flags |= MAP_POPULATE;
+#endif
+    *ppData = mmap(0, st.st_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (*ppData == MAP_FAILED) {
+        *ppData = 0;
+        goto __ret;
+    }
+    *pSize = (size_t)st.st_size;
+
+    erv = ERR_OK;
+__ret:
+    /* The mapping keeps its own reference to the file */
+    close(fd);
+
+    return erv;
+}
+
+/** Release a file mapped by _mapFile */
+static void _unmapFile(void *pData, size_t size) {
+    munmap(pData, size);
+}
+#endif
+
+/**
+ * Map a binary level into memory and validate it.
+ *
+ * @param  [out]pFile The mapped level
+ * @param  [ in]pPath Path to the file (relative to the working directory)
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE
+ */
+err openLevelFile(levelFile *pFile, const char *pPath) {
+    levelFileHeader *pHeader;
+    levelTiles *pTiles;
+    uint32_t *pOffsets;
+    size_t dataStart, chunkBytes;
+    int i, numChunks;
+    err erv;
+
+    memset(pFile, 0x0, sizeof(levelFile));
+    erv = _mapFile(&pFile->pMapping, &pFile->size, pPath);
+    if (erv != ERR_OK) {
+        return erv;
+    }
+
+    /* Outdated files are silently rejected, so the caller may fallback to
+     * something else */
+    erv = ERR_BADFILE;
+    pHeader = (levelFileHeader*)pFile->pMapping;
+    if (pFile->size < sizeof(levelFileHeader)
+            || pHeader->magic != LEVEL_FILE_MAGIC
+            || pHeader->version != LEVEL_FILE_VERSION
+            || pHeader->widthInTiles <= 0 || pHeader->heightInTiles <= 0
+            || pHeader->numTileTypes < 0
+            || (pHeader->bytesPerTile != 1 && pHeader->bytesPerTile != 2
+            && pHeader->bytesPerTile != 4)) {
+        goto __ret;
+    }
+
+    pTiles = &pFile->tiles;
+    pTiles->widthInTiles = pHeader->widthInTiles;
+    pTiles->heightInTiles = pHeader->heightInTiles;
+    pTiles->widthInChunks = (pHeader->widthInTiles + LEVEL_CHUNK_SIZE - 1)
+            / LEVEL_CHUNK_SIZE;
+    pTiles->heightInChunks = (pHeader->heightInTiles + LEVEL_CHUNK_SIZE - 1)
+            / LEVEL_CHUNK_SIZE;
+    pTiles->bytesPerTile = pHeader->bytesPerTile;
+    numChunks = pTiles->widthInChunks * pTiles->heightInChunks;
+
+    dataStart = sizeof(levelFileHeader)
+            + sizeof(int32_t) * pHeader->numTileTypes * 2
+            + sizeof(uint32_t) * numChunks;
+    if (pFile->size < dataStart) {
+        goto __ret;
+    }
+    pFile->numTileTypes = pHeader->numTileTypes;
+    pFile->pTileTypes = (int*)(pHeader + 1);
+    pOffsets = (uint32_t*)(pFile->pTileTypes + pHeader->numTileTypes * 2);
+
+    /* Point every non-empty chunk into the mapping (so it's only paged in
+     * when it's first accessed) */
+    pTiles->ppChunks = malloc(sizeof(void*) * numChunks);
+    ASSERT_TO(pTiles->ppChunks, erv = ERR_MALLOC, __ret);
+    chunkBytes = (size_t)pTiles->bytesPerTile * LEVEL_CHUNK_TILES;
+    i = 0;
+    while (i < numChunks) {
+        if (pOffsets[i] == 0) {
+            pTiles->ppChunks[i] = 0;
+        }
+        else if (pOffsets[i] < dataStart
+                || pOffsets[i] % pTiles->bytesPerTile != 0
+                || pOffsets[i] + chunkBytes > pFile->size) {
+            goto __ret;
+        }
+        else {
+            pTiles->ppChunks[i] = (uint8_t*)pFile->pMapping + pOffsets[i];
+            pTiles->numChunks++;
+        }
+        i++;
+    }
+
+    erv = ERR_OK;
+__ret:
+    if (erv != ERR_OK) {
+        closeLevelFile(pFile);
+    }
+
+    return erv;
+}
+
+/**
+ * Read a whole file into a '\0'-terminated buffer
+ *
+ * @param  [out]ppData The file's content (must be free'd)
+ * @param  [ in]pPath  Path to the file
+ */
+static err _readFile(char **ppData, const char *pPath) {
+    FILE *pFp;
+    long size;
+    err erv;
+
+    pFp = fopen(pPath, "rb");
+    if (!pFp) {
+        return ERR_OPENFILE;
+    }
+
+    *ppData = 0;
+    erv = ERR_OPENFILE;
+    if (fseek(pFp, 0, SEEK_END) != 0 || (size = ftell(pFp)) < 0
+            || fseek(pFp, 0, SEEK_SET) != 0) {
+        goto __ret;
+    }
+
+    *ppData = malloc(size + 1);
+    ASSERT_TO(*ppData, erv = ERR_MALLOC, __ret);
+    if (fread(*ppData, 1, size, pFp) != (size_t)size) {
+        goto __ret;
+    }
+    (*ppData)[size] = '\0';
+
+    erv = ERR_OK;
+__ret:
+    if (erv != ERR_OK) {
+        free(*ppData);
+        *ppData = 0;
+    }
+    fclose(pFp);
+
+    return erv;
+}
+
+/**
+ * Read a text level (see parseLevelText) into the same form as a binary one,
+ * so it may be used in its place.
+ *
+ * @param  [out]pFile The level (must be released by closeLevelFile)
+ * @param  [ in]pPath Path to the file
+ * @return ERR_OK, ERR_OPENFILE, ERR_BADFILE, ERR_MALLOC
+ */
+err openLevelText(levelFile *pFile, const char *pPath) {
+    levelText text;
+    char *pData;
+    err erv;
+
+    memset(pFile, 0x0, sizeof(levelFile));
+    memset(&text, 0x0, sizeof(levelText));
+    erv = _readFile(&pData, pPath);
+    if (erv != ERR_OK) {
+        return erv;
+    }
+
+    erv = parseLevelText(&text, pData);
+    ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+    erv = initLevelTiles(&pFile->tiles, text.pTiles, text.widthInTiles
+            , text.heightInTiles);
+    ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+
+    /* Keep the types (as there's no mapping to point into) */
+    pFile->numTileTypes = text.numTileTypes;
+    pFile->pTileTypes = text.pTileTypes;
+    text.pTileTypes = 0;
+
+    erv = ERR_OK;
+__ret:
+    freeLevelText(&text);
+    free(pData);
+    if (erv != ERR_OK) {
+        closeLevelFile(pFile);
+    }
+
+    return erv;
+}
+
+/**
+ * Release a level opened by openLevelFile or openLevelText (it's safe to call
+ * it twice)
+ */
+void closeLevelFile(levelFile *pFile) {
+    if (pFile->pMapping) {
+        _unmapFile(pFile->pMapping, pFile->size);
+    }
+    else {
+        free(pFile->pTileTypes);
+    }
+    freeLevelTiles(&pFile->tiles);
+    memset(pFile, 0x0, sizeof(levelFile));
+}
+
+/**
+ * Resolve a tile type's name into its in-game value (see
+ * conf/tiletype_list.h)
+ *
+ * @param  [out]pType The type
+ * @param  [ in]pName The name (doesn't have to be '\0'-terminated)
+ * @param  [ in]len   Length of the name
+ * @return            ERR_OK, ERR_BADFILE
+ */
+err resolveTileType(int *pType, const char *pName, size_t len) {
+#define X(name, value) \
+    if (len == sizeof(#name) - 1 && strncmp(pName, #name, len) == 0) { \
+        *pType = value; \
+        return ERR_OK; \
+    }
+    TILETYPE_LIST
+#undef X
+
+    return ERR_BADFILE;
+}
+
+/**
+ * Retrieve the next whitespace separated token from a text, '\0'-terminating
+ * it
+ *
+ * @param  [ io]ppCur Current position on the text (updated past the token)
+ * @return            The token (or 0, if the text ended)
+ */
+static char* _nextToken(char **ppCur) {
+    char *pTok;
+
+    pTok = *ppCur + strspn(*ppCur, " \t\r\n");
+    if (*pTok == '\0') {
+        *ppCur = pTok;
+        return 0;
+    }
+    *ppCur = pTok + strcspn(pTok, " \t\r\n");
+    if (**ppCur != '\0') {
+        **ppCur = '\0';
+        (*ppCur)++;
+    }
+
+    return pTok;
+}
+
+/**
+ * Parse a GFraMe text level (.gfm). Only 'type' and 'map' tokens are
+ * supported.
+ *
+ * @param  [out]pText The level (must be released by freeLevelText)
+ * @param  [ in]pData The whole file, '\0'-terminated (it's modified while
+ *                    parsing)
+ * @return            ERR_OK, ERR_BADFILE, ERR_MALLOC
+ */
+err parseLevelText(levelText *pText, char *pData) {
+    char *pTok, *pCur;
+    int maxTileTypes;
+    err erv;
+
+    memset(pText, 0x0, sizeof(levelText));
+    maxTileTypes = 0;
+    pCur = pData;
+    erv = ERR_BADFILE;
+    while ((pTok = _nextToken(&pCur)) != 0) {
+        if (strcmp(pTok, "type") == 0) {
+            char *pName, *pTile;
+
+            pName = _nextToken(&pCur);
+            pTile = _nextToken(&pCur);
+            if (!pName || !pTile) {
+                goto __ret;
+            }
+            if (pText->numTileTypes == maxTileTypes) {
+                int *pTmp;
+
+                maxTileTypes = maxTileTypes * 2 + 8;
+                pTmp = realloc(pText->pTileTypes
+                        , sizeof(int) * 2 * maxTileTypes);
+                ASSERT_TO(pTmp, erv = ERR_MALLOC, __ret);
+                pText->pTileTypes = pTmp;
+            }
+            pText->pTileTypes[pText->numTileTypes * 2] = atoi(pTile);
+            if (resolveTileType(&pText->pTileTypes[pText->numTileTypes * 2 + 1]
+                    , pName, strlen(pName)) != ERR_OK) {
+                goto __ret;
+            }
+            pText->numTileTypes++;
+        }
+        else if (strcmp(pTok, "map") == 0 && !pText->pTiles) {
+            char *pNum;
+            int i;
+
+            pNum = _nextToken(&pCur);
+            pText->widthInTiles = pNum ? atoi(pNum) : 0;
+            pNum = _nextToken(&pCur);
+            pText->heightInTiles = pNum ? atoi(pNum) : 0;
+            if (pText->widthInTiles <= 0 || pText->heightInTiles <= 0) {
+                goto __ret;
+            }
+            pText->pTiles = malloc(sizeof(int) * pText->widthInTiles
+                    * pText->heightInTiles);
+            ASSERT_TO(pText->pTiles, erv = ERR_MALLOC, __ret);
+
+            i = 0;
+            while (i < pText->widthInTiles * pText->heightInTiles) {
+                pNum = _nextToken(&pCur);
+                if (!pNum) {
+                    goto __ret;
+                }
+                pText->pTiles[i] = atoi(pNum);
+                i++;
+            }
+        }
+        else {
+            goto __ret;
+        }
+    }
+    if (!pText->pTiles) {
+        goto __ret;
+    }
+
+    erv = ERR_OK;
+__ret:
+    if (erv != ERR_OK) {
+        freeLevelText(pText);
+    }
+
+    return erv;
+}
+
+/** Release a level parsed by parseLevelText (it's safe to call it twice) */
+void freeLevelText(levelText *pText) {
+    free(pText->pTiles);
+    free(pText->pTileTypes);
+    memset(pText, 0x0, sizeof(levelText));
+}
+
+/**
+ * Retrieve the narrowest size (in bytes) able to store every tile on a map
+ *
+ * @param  [ in]pTiles   The tiles
+ * @param  [ in]numTiles Number of tiles
+ */
+int getLevelTileSize(const int *pTiles, int numTiles) {
+    int i, bytesPerTile;
+
+    /* The value with every bit set is reserved for the empty tile */
+    bytesPerTile = 1;
+    i = 0;
+    while (i < numTiles) {
+        if (pTiles[i] < -1 || pTiles[i] >= UINT16_MAX) {
+            return 4;
+        }
+        else if (pTiles[i] >= UINT8_MAX) {
+            bytesPerTile = 2;
+        }
+        i++;
+    }
+
+    return bytesPerTile;
+}
+
+/**
+ * Convert tiles into their compact form
+ *
+ * @param  [out]pDst         The compact tiles
+ * @param  [ in]pSrc         The tiles
+ * @param  [ in]numTiles     Number of tiles
+ * @param  [ in]bytesPerTile Size of each compact tile (see getLevelTileSize)
+ */
+void packLevelTiles(void *pDst, const int *pSrc, int numTiles
+        , int bytesPerTile) {
+    int i;
+
+    i = 0;
+    switch (bytesPerTile) {
+        case 1: {
+            while (i < numTiles) {
+                ((uint8_t*)pDst)[i] = (uint8_t)pSrc[i];
+                i++;
+            }
+        } break;
+        case 2: {
+            while (i < numTiles) {
+                ((uint16_t*)pDst)[i] = (uint16_t)pSrc[i];
+                i++;
+            }
+        } break;
+        default: {
+            memcpy(pDst, pSrc, sizeof(int32_t) * numTiles);
+        }
+    }
+}
+
+/**
+ * Split a map into compact chunks, skipping the empty ones
+ *
+ * @param  [out]pTiles The chunks (must be released by freeLevelTiles)
+ * @param  [ in]pData  The map, on its default orientation
+ * @param  [ in]width  The map's width in tiles
+ * @param  [ in]height The map's height in tiles
+ */
+err initLevelTiles(levelTiles *pTiles, const int *pData, int width
+        , int height) {
+    int chunk[LEVEL_CHUNK_TILES];
+    int cx, cy, numChunks;
+    size_t chunkBytes;
+    uint8_t *pNext;
+    err erv;
+
+    memset(pTiles, 0x0, sizeof(levelTiles));
+    pTiles->widthInTiles = width;
+    pTiles->heightInTiles = height;
+    pTiles->widthInChunks = (width + LEVEL_CHUNK_SIZE - 1) / LEVEL_CHUNK_SIZE;
+    pTiles->heightInChunks = (height + LEVEL_CHUNK_SIZE - 1)
+            / LEVEL_CHUNK_SIZE;
+    pTiles->bytesPerTile = getLevelTileSize(pData, width * height);
+    numChunks = pTiles->widthInChunks * pTiles->heightInChunks;
+    chunkBytes = (size_t)pTiles->bytesPerTile * LEVEL_CHUNK_TILES;
+
+    pTiles->ppChunks = calloc(numChunks, sizeof(void*));
+    ASSERT_TO(pTiles->ppChunks, erv = ERR_MALLOC, __ret);
+
+    /* Find every non-empty chunk (temporarily marking them with a non-null
+     * pointer), so the buffer may be alloc'ed at once */
+    cy = 0;
+    while (cy < height) {
+        cx = 0;
+        while (cx < width) {
+            int x, y;
+
+            y = cy;
+            while (y < height && y < cy + LEVEL_CHUNK_SIZE) {
+                x = cx;
+                while (x < width && x < cx + LEVEL_CHUNK_SIZE
+                        && pData[x + y * width] == -1) {
+                    x++;
+                }
+                if (x < width && x < cx + LEVEL_CHUNK_SIZE) {
+                    pTiles->ppChunks[cx / LEVEL_CHUNK_SIZE
+                            + (cy / LEVEL_CHUNK_SIZE) * pTiles->widthInChunks]
+                            = pTiles;
+                    pTiles->numChunks++;
+                    break;
+                }
+                y++;
+            }
+            cx += LEVEL_CHUNK_SIZE;
+        }
+        cy += LEVEL_CHUNK_SIZE;
+    }
+
+    pTiles->pBuffer = malloc(chunkBytes * pTiles->numChunks);
+    ASSERT_TO(pTiles->pBuffer || pTiles->numChunks == 0, erv = ERR_MALLOC
+            , __ret);
+
+    /* Pack every non-empty chunk (padded with empty tiles) */
+    pNext = pTiles->pBuffer;
+    cy = 0;
+    while (cy < pTiles->heightInChunks) {
+        cx = 0;
+        while (cx < pTiles->widthInChunks) {
+            void **ppChunk;
+            int x, y;
+
+            ppChunk = &pTiles->ppChunks[cx + cy * pTiles->widthInChunks];
+            if (!*ppChunk) {
+                cx++;
+                continue;
+            }
+
+            y = 0;
+            while (y < LEVEL_CHUNK_SIZE) {
+                x = 0;
+                while (x < LEVEL_CHUNK_SIZE) {
+                    int tx, ty;
+
+                    tx = cx * LEVEL_CHUNK_SIZE + x;
+                    ty = cy * LEVEL_CHUNK_SIZE + y;
+                    if (tx < width && ty < height) {
+                        chunk[x + y * LEVEL_CHUNK_SIZE] = pData[tx + ty * width];
+                    }
+                    else {
+                        chunk[x + y * LEVEL_CHUNK_SIZE] = -1;
+                    }
+                    x++;
+                }
+                y++;
+            }
+            packLevelTiles(pNext, chunk, LEVEL_CHUNK_TILES
+                    , pTiles->bytesPerTile);
+            *ppChunk = pNext;
+            pNext += chunkBytes;
+            cx++;
+        }
+        cy++;
+    }
+
+    erv = ERR_OK;
+__ret:
+    if (erv != ERR_OK) {
+        freeLevelTiles(pTiles);
+    }
+
+    return erv;
+}
+
+/** Release chunks created by initLevelTiles (it's safe to call it twice) */
+void freeLevelTiles(levelTiles *pTiles) {
+    free(pTiles->ppChunks);
+    free(pTiles->pBuffer);
+    memset(pTiles, 0x0, sizeof(levelTiles));
+}
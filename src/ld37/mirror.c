@@ -0,0 +1,469 @@
+/**
+ * @file src/ld37/mirror.c
+ *
+ * Table-driven kernel that generates the mirrored orientations of a level.
+ */
+#include <conf/tilesymmetry_list.h>
+#include <ld37/level.h>
+#include <ld37/levelFile.h>
+#include <ld37/mirror.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#endif
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+/** Number of entries on each lookup table. Tiles are offset by one, so the
+ * empty tile (-1) is also on the table */
+#define MIRROR_LUT_LEN (MIRROR_NUM_TILES + 1)
+
+/** Tile remapping for every orientation, indexed by (tile + 1) */
+static int mirrorLut[LO_MAX][MIRROR_LUT_LEN];
+
+/** A row of empty tiles (i.e., with every bit set), used for empty chunks */
+static uint8_t emptyRow[LEVEL_CHUNK_SIZE * sizeof(int32_t)];
+
+/** Arguments for mirroring a band of chunk rows */
+struct stMirrorJob {
+    int *pDst;
+    const levelTiles *pSrc;
+    int firstChunkRow;
+    int lastChunkRow;
+    levelOrientation orientation;
+};
+typedef struct stMirrorJob mirrorJob;
+
+/** Generate the lookup tables for every orientation */
+void initMirrorTables() {
+    int i;
+
+    memset(emptyRow, 0xff, sizeof(emptyRow));
+
+    i = 0;
+    while (i < MIRROR_LUT_LEN) {
+        mirrorLut[LO_DEFAULT][i] = i - 1;
+        mirrorLut[LO_HORIZONTAL_MIRROR][i] = i - 1;
+        mirrorLut[LO_VERTICAL_MIRROR][i] = i - 1;
+        mirrorLut[LO_TRANSPOSE][i] = i - 1;
+        i++;
+    }
+
+#define X(tile, horizontal, vertical, transpose) \
+    mirrorLut[LO_HORIZONTAL_MIRROR][(tile) + 1] = horizontal; \
+    mirrorLut[LO_VERTICAL_MIRROR][(tile) + 1] = vertical; \
+    mirrorLut[LO_TRANSPOSE][(tile) + 1] = transpose;
+    TILESYMMETRY_LIST
+#undef X
+
+    /* Every other orientation transposes the tile (if needed) and then
+     * mirrors it, in the same order as the level itself */
+    i = 0;
+    while (i < MIRROR_LUT_LEN) {
+        int tile;
+
+        tile = mirrorLut[LO_VERTICAL_MIRROR][i];
+        mirrorLut[LO_MIRROR_BOTH][i] =
+                mirrorLut[LO_HORIZONTAL_MIRROR][tile + 1];
+
+        tile = mirrorLut[LO_TRANSPOSE][i];
+        mirrorLut[LO_ROTATE_CW][i] = mirrorLut[LO_HORIZONTAL_MIRROR][tile + 1];
+        mirrorLut[LO_ROTATE_CCW][i] = mirrorLut[LO_VERTICAL_MIRROR][tile + 1];
+        mirrorLut[LO_ANTITRANSPOSE][i] = mirrorLut[LO_MIRROR_BOTH][tile + 1];
+        i++;
+    }
+}
+
+/**
+ * Retrieve a tile on a given orientation
+ *
+ * @param  [ in]tile        The tile, in its default orientation
+ * @param  [ in]orientation The new orientation
+ */
+int mirrorTile(int tile, levelOrientation orientation) {
+    if ((unsigned)(tile + 1) >= MIRROR_LUT_LEN) {
+        return tile;
+    }
+    return mirrorLut[orientation][tile + 1];
+}
+
+/**
+ * Retrieve the position of a tile on a given orientation
+ *
+ * @param  [out]pX          Horizontal position on the new orientation
+ * @param  [out]pY          Vertical position on the new orientation
+ * @param  [ in]x           Horizontal position on the default orientation
+ * @param  [ in]y           Vertical position on the default orientation
+ * @param  [ in]width       The map's width in tiles (on the default one)
+ * @param  [ in]height      The map's height in tiles (on the default one)
+ * @param  [ in]orientation The new orientation
+ */
+void mirrorPosition(int *pX, int *pY, int x, int y, int width, int height
+        , levelOrientation orientation) {
+    if (orientation & LO_TRANSPOSE) {
+        int tmp;
+
+        tmp = x;
+        x = y;
+        y = tmp;
+        tmp = width;
+        width = height;
+        height = tmp;
+    }
+    if (orientation & LO_HORIZONTAL_MIRROR) {
+        x = width - x - 1;
+    }
+    if (orientation & LO_VERTICAL_MIRROR) {
+        y = height - y - 1;
+    }
+
+    *pX = x;
+    *pY = y;
+}
+
+/**
+ * Retrieve the position of a tile on the default orientation (i.e., the
+ * inverse of mirrorPosition)
+ *
+ * @param  [out]pX          Horizontal position on the default orientation
+ * @param  [out]pY          Vertical position on the default orientation
+ * @param  [ in]x           Horizontal position on the given orientation
+ * @param  [ in]y           Vertical position on the given orientation
+ * @param  [ in]width       The map's width in tiles (on the default one)
+ * @param  [ in]height      The map's height in tiles (on the default one)
+ * @param  [ in]orientation The orientation of x and y
+ */
+void unmirrorPosition(int *pX, int *pY, int x, int y, int width, int height
+        , levelOrientation orientation) {
+    if (orientation & LO_TRANSPOSE) {
+        int tmp;
+
+        tmp = width;
+        width = height;
+        height = tmp;
+    }
+    if (orientation & LO_HORIZONTAL_MIRROR) {
+        x = width - x - 1;
+    }
+    if (orientation & LO_VERTICAL_MIRROR) {
+        y = height - y - 1;
+    }
+
+    if (orientation & LO_TRANSPOSE) {
+        *pX = y;
+        *pY = x;
+    }
+    else {
+        *pX = x;
+        *pY = y;
+    }
+}
+
+/**
+ * Transpose (and mirror and remap) a segment of a row. The row becomes a
+ * column on the destination, so this can't be vectorized as simply as
+ * _mirrorSegment.
+ *
+ * @param  [ in]pJob    The job being executed
+ * @param  [ in]pSrcRow The segment's (compact) tiles
+ * @param  [ in]x       Horizontal position of the segment's first tile
+ * @param  [ in]y       Vertical position of the segment
+ * @param  [ in]len     Number of tiles on the segment
+ */
+static void _transposeSegment(const mirrorJob *pJob, const void *pSrcRow
+        , int x, int y, int len) {
+    const int *pLut;
+    int *pDst;
+    int j, width, height, bytesPerTile, stride;
+
+    pLut = mirrorLut[pJob->orientation];
+    width = pJob->pSrc->widthInTiles;
+    height = pJob->pSrc->heightInTiles;
+    bytesPerTile = pJob->pSrc->bytesPerTile;
+
+    /* The destination is height tiles wide, and the segment is written to
+     * column y (or its mirror) from top to bottom (or bottom to top) */
+    if (pJob->orientation & LO_HORIZONTAL_MIRROR) {
+        pDst = pJob->pDst + (height - y - 1);
+    }
+    else {
+        pDst = pJob->pDst + y;
+    }
+    if (pJob->orientation & LO_VERTICAL_MIRROR) {
+        pDst += (width - x - 1) * height;
+        stride = -height;
+    }
+    else {
+        pDst += x * height;
+        stride = height;
+    }
+
+    j = 0;
+    while (j < len) {
+        int tile;
+
+        tile = readLevelTile(pSrcRow, bytesPerTile, j);
+        if ((unsigned)(tile + 1) < MIRROR_LUT_LEN) {
+            tile = pLut[tile + 1];
+        }
+        *pDst = tile;
+        pDst += stride;
+        j++;
+    }
+}
+
+/**
+ * Mirror (and remap) a segment of a row.
+ *
+ * @param  [ in]pJob    The job being executed
+ * @param  [ in]pSrcRow The segment's (compact) tiles
+ * @param  [ in]x       Horizontal position of the segment's first tile
+ * @param  [ in]y       Vertical position of the segment
+ * @param  [ in]len     Number of tiles on the segment
+ */
+static void _mirrorSegment(const mirrorJob *pJob, const void *pSrcRow, int x
+        , int y, int len) {
+    const int *pLut;
+    int *pDstRow;
+    int j, width, bytesPerTile;
+
+    pLut = mirrorLut[pJob->orientation];
+    width = pJob->pSrc->widthInTiles;
+    bytesPerTile = pJob->pSrc->bytesPerTile;
+
+    if (pJob->orientation & LO_VERTICAL_MIRROR) {
+        pDstRow = pJob->pDst + (pJob->pSrc->heightInTiles - y - 1) * width;
+    }
+    else {
+        pDstRow = pJob->pDst + y * width;
+    }
+    /* Point to the segment's first tile, so only the direction changes */
+    if (pJob->orientation & LO_HORIZONTAL_MIRROR) {
+        pDstRow += width - x - 1;
+    }
+    else {
+        pDstRow += x;
+    }
+
+    j = 0;
+#if defined(__AVX2__)
+    {
+        __m256i one, minusOne, lutLen, reverse, mask;
+
+        one = _mm256_set1_epi32(1);
+        minusOne = _mm256_set1_epi32(-1);
+        lutLen = _mm256_set1_epi32(MIRROR_LUT_LEN);
+        reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        /* Compact tiles are offset and then wrapped around, so their empty
+         * tile also becomes index 0 */
+        if (bytesPerTile == 1) {
+            mask = _mm256_set1_epi32(UINT8_MAX);
+        }
+        else if (bytesPerTile == 2) {
+            mask = _mm256_set1_epi32(UINT16_MAX);
+        }
+        else {
+            mask = minusOne;
+        }
+        while (j + 8 <= len) {
+            __m256i tiles, index, inRange;
+
+            /* Widen the tiles into 32 bits integers */
+            if (bytesPerTile == 1) {
+                tiles = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                        (const __m128i*)((const uint8_t*)pSrcRow + j)));
+            }
+            else if (bytesPerTile == 2) {
+                tiles = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+                        (const __m128i*)((const uint16_t*)pSrcRow + j)));
+            }
+            else {
+                tiles = _mm256_loadu_si256(
+                        (const __m256i*)((const int32_t*)pSrcRow + j));
+            }
+
+            /* Tiles outside the table are kept as is (i.e., the gather
+             * falls back to the loaded tiles) */
+            index = _mm256_and_si256(_mm256_add_epi32(tiles, one), mask);
+            tiles = _mm256_sub_epi32(index, one);
+            inRange = _mm256_and_si256(_mm256_cmpgt_epi32(lutLen, index)
+                    , _mm256_cmpgt_epi32(index, minusOne));
+            tiles = _mm256_mask_i32gather_epi32(tiles, pLut, index
+                    , inRange, 4);
+
+            if (pJob->orientation & LO_HORIZONTAL_MIRROR) {
+                tiles = _mm256_permutevar8x32_epi32(tiles, reverse);
+                _mm256_storeu_si256((__m256i*)(pDstRow - j - 7), tiles);
+            }
+            else {
+                _mm256_storeu_si256((__m256i*)(pDstRow + j), tiles);
+            }
+            j += 8;
+        }
+    }
+#endif
+    /* Scalar fallback (and the tail of the vectorized loop) */
+    if (pJob->orientation & LO_HORIZONTAL_MIRROR) {
+        while (j < len) {
+            int tile;
+
+            tile = readLevelTile(pSrcRow, bytesPerTile, j);
+            if ((unsigned)(tile + 1) < MIRROR_LUT_LEN) {
+                tile = pLut[tile + 1];
+            }
+            pDstRow[-j] = tile;
+            j++;
+        }
+    }
+    else {
+        while (j < len) {
+            int tile;
+
+            tile = readLevelTile(pSrcRow, bytesPerTile, j);
+            if ((unsigned)(tile + 1) < MIRROR_LUT_LEN) {
+                tile = pLut[tile + 1];
+            }
+            pDstRow[j] = tile;
+            j++;
+        }
+    }
+}
+
+/**
+ * Mirror (and remap) a band of chunk rows, one row of each chunk at a time.
+ * Empty chunks are simply filled with empty tiles.
+ *
+ * @param  [ in]pJob The chunk rows being mirrored
+ */
+static void _mirrorChunks(const mirrorJob *pJob) {
+    const levelTiles *pTiles;
+    int cx, cy, rowBytes;
+
+    pTiles = pJob->pSrc;
+    rowBytes = pTiles->bytesPerTile * LEVEL_CHUNK_SIZE;
+
+    cy = pJob->firstChunkRow;
+    while (cy < pJob->lastChunkRow) {
+        cx = 0;
+        while (cx < pTiles->widthInChunks) {
+            const uint8_t *pChunk;
+            int x, y, len;
+
+            pChunk = pTiles->ppChunks[cx + cy * pTiles->widthInChunks];
+            x = cx * LEVEL_CHUNK_SIZE;
+            len = pTiles->widthInTiles - x;
+            if (len > LEVEL_CHUNK_SIZE) {
+                len = LEVEL_CHUNK_SIZE;
+            }
+
+            y = cy * LEVEL_CHUNK_SIZE;
+            while (y < pTiles->heightInTiles
+                    && y < (cy + 1) * LEVEL_CHUNK_SIZE) {
+                const void *pRow;
+
+                if (pChunk) {
+                    pRow = pChunk + (y % LEVEL_CHUNK_SIZE) * rowBytes;
+                }
+                else {
+                    pRow = emptyRow;
+                }
+
+                if (pJob->orientation & LO_TRANSPOSE) {
+                    _transposeSegment(pJob, pRow, x, y, len);
+                }
+                else {
+                    _mirrorSegment(pJob, pRow, x, y, len);
+                }
+                y++;
+            }
+            cx++;
+        }
+        cy++;
+    }
+}
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+/** Entry point for the worker threads */
+static void* _mirrorThread(void *pArg) {
+    _mirrorChunks((const mirrorJob*)pArg);
+    return 0;
+}
+#endif
+
+/**
+ * Generate a new orientation of a map. initMirrorTables must have been called
+ * beforehand.
+ *
+ * @param  [out]pDst        The mirrored map (must not overlap pSrc). If
+ *                          transposed, it's height tiles wide
+ * @param  [ in]pSrc        The map's chunks, in its default orientation
+ * @param  [ in]orientation The new orientation
+ */
+void mirrorTilemap(int *pDst, const levelTiles *pSrc
+        , levelOrientation orientation) {
+    mirrorJob jobs[MIRROR_MAX_THREADS];
+    int i, numJobs;
+#if !(defined(__WIN32) || defined(__WIN32__))
+    pthread_t threads[MIRROR_MAX_THREADS];
+    int didStart[MIRROR_MAX_THREADS];
+#endif
+
+    numJobs = 1;
+#if !(defined(__WIN32) || defined(__WIN32__))
+    if (pSrc->widthInTiles * pSrc->heightInTiles >= MIRROR_THREAD_MIN_TILES) {
+        long numCpus;
+
+        numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (numCpus > MIRROR_MAX_THREADS) {
+            numJobs = MIRROR_MAX_THREADS;
+        }
+        else if (numCpus > 1) {
+            numJobs = (int)numCpus;
+        }
+    }
+    if (numJobs > pSrc->heightInChunks) {
+        numJobs = pSrc->heightInChunks;
+    }
+#endif
+
+    /* Split the map into bands of (almost) the same number of chunk rows */
+    i = 0;
+    while (i < numJobs) {
+        jobs[i].pDst = pDst;
+        jobs[i].pSrc = pSrc;
+        jobs[i].firstChunkRow = pSrc->heightInChunks * i / numJobs;
+        jobs[i].lastChunkRow = pSrc->heightInChunks * (i + 1) / numJobs;
+        jobs[i].orientation = orientation;
+        i++;
+    }
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+    /* Mirror the first band on this thread and every other on a worker. If a
+     * thread couldn't be started, its band is mirrored on this thread. */
+    i = 1;
+    while (i < numJobs) {
+        didStart[i] = (pthread_create(&threads[i], 0, _mirrorThread, &jobs[i])
+                == 0);
+        i++;
+    }
+    _mirrorChunks(&jobs[0]);
+    i = 1;
+    while (i < numJobs) {
+        if (didStart[i]) {
+            pthread_join(threads[i], 0);
+        }
+        else {
+            _mirrorChunks(&jobs[i]);
+        }
+        i++;
+    }
+#else
+    _mirrorChunks(&jobs[0]);
+#endif
+}
@@ -1,15 +1,49 @@
 #include <base/error.h>
 #include <base/game.h>
+#include <base/gfx.h>
 #include <base/input.h>
+#include <base/profiler.h>
+#include <base/replay.h>
+#include <base/snapshot.h>
 #include <GFraMe/gfmTilemap.h>
 #include <ld37/level.h>
 #include <ld37/test.h>
 
+/** Room currently being tested */
+static levelRoom curRoom = (levelRoom)0;
+/** Room that will be switched to as soon as it's loaded (or LR_MAX, if none) */
+static levelRoom pendingRoom = LR_MAX;
+/** Orientation currently being tested */
+static levelOrientation testOrientation = LO_DEFAULT;
+/** Tilemap where the level is drawn (owned by the renderer, as the level
+ * itself doesn't use GFraMe) */
+static gfmTilemap *pRenderMap = 0;
+/** Version of the tiles last loaded into pRenderMap */
+static unsigned int renderVersion = 0;
+
+err prepareTest() {
+    /* The test always starts on the first room */
+    return preloadRoom((levelRoom)0);
+}
+
+int isTestReady() {
+    return isRoomReady((levelRoom)0);
+}
+
 err initTest() {
     err erv;
 
     erv = loadLevel(LO_DEFAULT);
     ASSERT(erv == ERR_OK, erv);
+    testOrientation = LO_DEFAULT;
+    /* Only blocks if the room wasn't prepared (i.e., on a timeout) */
+    curRoom = (levelRoom)0;
+    pendingRoom = LR_MAX;
+    erv = switchRoom(curRoom);
+    ASSERT(erv == ERR_OK, erv);
+    /* Start streaming the next room right away */
+    erv = preloadRoom((curRoom + 1) % LR_MAX);
+    ASSERT(erv == ERR_OK, erv);
 
     return ERR_OK;
 }
@@ -17,39 +51,136 @@ err initTest() {
 void cleanTest() {
 }
 
+void cleanTestRenderer() {
+    gfmTilemap_free(&pRenderMap);
+    renderVersion = 0;
+}
+
 err updateTest() {
-    gfmRV rv;
+    levelOrientation orientation;
     err erv;
 
+    /* Arrows select the mirroring, while grapple toggles the transposition */
+    orientation = testOrientation;
     if (DID_JUST_PRESS(left)) {
-        erv = loadLevel(LO_DEFAULT);
-        ASSERT(erv == ERR_OK, erv);
+        orientation = (orientation & LO_TRANSPOSE) | LO_DEFAULT;
     }
     else if (DID_JUST_PRESS(right)) {
-        erv = loadLevel(LO_HORIZONTAL_MIRROR);
-        ASSERT(erv == ERR_OK, erv);
+        orientation = (orientation & LO_TRANSPOSE) | LO_HORIZONTAL_MIRROR;
     }
     else if (DID_JUST_PRESS(up)) {
-        erv = loadLevel(LO_VERTICAL_MIRROR);
-        ASSERT(erv == ERR_OK, erv);
+        orientation = (orientation & LO_TRANSPOSE) | LO_VERTICAL_MIRROR;
     }
     else if (DID_JUST_PRESS(down)) {
-        erv = loadLevel(LO_MIRROR_BOTH);
+        orientation = (orientation & LO_TRANSPOSE) | LO_MIRROR_BOTH;
+    }
+    else if (DID_JUST_PRESS(grapple)) {
+        orientation ^= LO_TRANSPOSE;
+    }
+    if (orientation != testOrientation) {
+        PROFILE_BEGIN(loadLevel);
+        erv = loadLevel(orientation);
         ASSERT(erv == ERR_OK, erv);
+        PROFILE_END(loadLevel);
+        testOrientation = orientation;
     }
 
-    rv = gfmTilemap_update(pMap, game.pCtx);
-    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    /* Jumping requests the next room, which keeps loading on the background
+     * (while the current one is still simulated) */
+    if (DID_JUST_PRESS(jump) && pendingRoom == LR_MAX) {
+        pendingRoom = (curRoom + 1) % LR_MAX;
+        erv = preloadRoom(pendingRoom);
+        ASSERT(erv == ERR_OK, erv);
+    }
+
+    /* Rooms aren't switched while leaving, as the next state may be loading
+     * a room on the background. While recording (or replaying), the room is
+     * switched right away (blocking if needed), so it happens on the same
+     * step regardless of how long it took to load */
+    if (pendingRoom != LR_MAX && game.nextState == ST_NONE
+            && (isRoomReady(pendingRoom) || isRecording() || isReplaying())) {
+        PROFILE_BEGIN(loadLevel);
+        erv = switchRoom(pendingRoom);
+        ASSERT(erv == ERR_OK, erv);
+        PROFILE_END(loadLevel);
+        curRoom = pendingRoom;
+        pendingRoom = LR_MAX;
+        erv = preloadRoom((curRoom + 1) % LR_MAX);
+        ASSERT(erv == ERR_OK, erv);
+    }
 
     return ERR_OK;
 }
 
-err drawTest() {
+/**
+ * Draw the level's tiles, reloading them into the renderer's tilemap whenever
+ * they change
+ *
+ * @param  [ in]pData   The tiles
+ * @param  [ in]width   The width in tiles
+ * @param  [ in]height  The height in tiles
+ * @param  [ in]version Changes whenever the tiles do
+ */
+static err _drawLevel(const int *pData, int width, int height
+        , unsigned int version) {
     gfmRV rv;
 
-    rv = gfmTilemap_draw(pMap, game.pCtx);
+    if (!pRenderMap) {
+        rv = gfmTilemap_getNew(&pRenderMap);
+        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+        rv = gfmTilemap_init(pRenderMap, gfx.pSset8x8, width, height
+                , TM_DEF_TILE);
+        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+        /* Make sure the tiles get loaded */
+        renderVersion = version + 1;
+    }
+    if (version != renderVersion) {
+        rv = gfmTilemap_load(pRenderMap, (int*)pData, width * height, width
+                , height);
+        ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+        renderVersion = version;
+    }
+
+    rv = gfmTilemap_draw(pRenderMap, game.pCtx);
     ASSERT(rv == GFMRV_OK, ERR_GFMERR);
 
     return ERR_OK;
 }
 
+err drawTest() {
+    const int *pData;
+    int width, height;
+    unsigned int version;
+
+    version = getLevelData(&pData, &width, &height);
+    return _drawLevel(pData, width, height, version);
+}
+
+err snapshotTest(snapshot *pSnapshot) {
+    const int *pData;
+    int width, height;
+    unsigned int version;
+    err erv;
+
+    /* Each buffer keeps its tiles, so they are only copied if they changed
+     * since the buffer was last written */
+    version = getLevelData(&pData, &width, &height);
+    if (pSnapshot->pTiles && pSnapshot->tilesVersion == version) {
+        return ERR_OK;
+    }
+    erv = setSnapshotTiles(pSnapshot, pData, width, height);
+    ASSERT(erv == ERR_OK, erv);
+    pSnapshot->tilesVersion = version;
+
+    return ERR_OK;
+}
+
+err drawTestSnapshot(const snapshot *pSnapshot) {
+    if (!pSnapshot->pTiles) {
+        return ERR_OK;
+    }
+
+    /* The tiles are only reloaded if the simulation switched them */
+    return _drawLevel(pSnapshot->pTiles, pSnapshot->widthInTiles
+            , pSnapshot->heightInTiles, pSnapshot->tilesVersion);
+}
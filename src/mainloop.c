@@ -6,7 +6,11 @@
 #include <base/game.h>
 #include <base/input.h>
 #include <base/mainloop.h>
+#include <base/profiler.h>
+#include <base/replay.h>
+#include <base/snapshot.h>
 
+#include <conf/game.h>
 #include <conf/state.h>
 
 #include <GFraMe/gframe.h>
@@ -16,62 +20,517 @@
 #include <ld37/level.h>
 #include <ld37/test.h>
 
-/** Run the main loop until the game is closed */
-err mainloop() {
+#include <stdio.h>
+#include <string.h>
+#if !(defined(__WIN32) || defined(__WIN32__))
+#  include <pthread.h>
+#endif
+
+/** Phases of each step of the simulation (timed on headless mode). Colliding
+ * objects (while updating the state) is accounted as collision */
+enum enPhase {
+    PH_INPUT = 0,
+    PH_UPDATE,
+    PH_COLLISION,
+    PH_MAX
+};
+typedef enum enPhase phase;
+
+/** Name of every phase */
+static const char *phaseNames[PH_MAX] = {
+    "input",
+    "update",
+    "collision"
+};
+
+/** State whose resources are being loaded (or ST_NONE) */
+static state loadingState = ST_NONE;
+/** Number of steps spent waiting for loadingState */
+static int loadingSteps = 0;
+
+/**
+ * Switch to the next state, if any was requested. The next state's resources
+ * are first loaded on the background while the current state keeps running,
+ * and it's only switched to once they are ready (or after STATE_LOAD_TIMEOUT
+ * steps, if set, in which case the remaining resources are loaded right away).
+ * If another state is requested meanwhile, the first one is abandoned. The
+ * current state shouldn't start loading anything else while game.nextState is
+ * set, as that could discard the next state's resources.
+ *
+ * Since how long the resources take to load depends on the machine, states
+ * are switched right away (waiting for whatever is left to load) while
+ * recording or replaying. Otherwise, replays could diverge.
+ *
+ * Must be called exactly once per step.
+ */
+static err _switchState() {
+    int isReady;
+    err erv;
+
+    if (game.nextState == ST_NONE) {
+        return ERR_OK;
+    }
+
+    /* Start loading the next state */
+    if (loadingState != game.nextState) {
+        erv = ERR_OK;
+        switch (game.nextState) {
+            case ST_DUMMY: break;
+            case ST_TEST: erv = prepareTest(); break;
+            default: {}
+        }
+        ASSERT(erv == ERR_OK, erv);
+        loadingState = game.nextState;
+        loadingSteps = 0;
+    }
+
+    isReady = 1;
+    switch (loadingState) {
+        case ST_DUMMY: break;
+        case ST_TEST: isReady = isTestReady(); break;
+        default: {}
+    }
+    loadingSteps++;
+    if (!isReady && !isRecording() && !isReplaying()
+            && (STATE_LOAD_TIMEOUT <= 0 || loadingSteps < STATE_LOAD_TIMEOUT)) {
+        return ERR_OK;
+    }
+
+    /* Leave the current state and finish initializing the next one (which
+     * only blocks if it timed out) */
+    switch (game.currentState) {
+        case ST_DUMMY: break;
+        case ST_TEST: cleanTest(); break;
+        default: {}
+    }
+    /* The incremental hash keeps (sleeping) objects between frames, which
+     * were just released along with the previous state */
+    clearIncrementalHash(&collision.incremental);
+    erv = ERR_OK;
+    switch (loadingState) {
+        case ST_DUMMY: break;
+        case ST_TEST: erv = initTest(); break;
+        default: {}
+    }
+    ASSERT(erv == ERR_OK, erv);
+
+    game.currentState = loadingState;
+    game.nextState = ST_NONE;
+    loadingState = ST_NONE;
+
+    return ERR_OK;
+}
+
+/**
+ * Switch states (if requested), update the current state (which collides its
+ * objects) and resolve any gathered collision, using the buttons on the
+ * global input. This never touches the framework's context, so it may run on
+ * any thread.
+ *
+ * @param  [ in]elapsed Time elapsed since the previous step, in milliseconds
+ * @param  [ in]pTimes  Time spent on each phase, in seconds (accumulated)
+ */
+static err _simulate(int elapsed, double *pTimes) {
+    double start, now;
+    int width, height;
+    err erv;
+
+    erv = _switchState();
+    ASSERT(erv == ERR_OK, erv);
+
+    /* The dynamic broadphase covers the whole room */
+    start = getProfilerTime();
+    width = V_WIDTH;
+    height = V_HEIGHT;
+    if (collision.pTiles) {
+        width = collision.widthInTiles << STATIC_TILE_BITS;
+        height = collision.heightInTiles << STATIC_TILE_BITS;
+    }
+    erv = resetCollision(0, 0, width, height);
+    ASSERT(erv == ERR_OK, erv);
+    now = getProfilerTime();
+    pTimes[PH_COLLISION] += now - start;
+
+    start = now;
+    game.elapsed = elapsed;
+
+    /* Update the current state */
+    PROFILE_BEGIN(update);
+    erv = ERR_OK;
+    switch (game.currentState) {
+        case ST_DUMMY: break;
+        case ST_TEST: erv = updateTest(); break;
+        default: {}
+    }
+    ASSERT(erv == ERR_OK, erv);
+    PROFILE_END(update);
+    now = getProfilerTime();
+    pTimes[PH_UPDATE] += now - start - collision.collideTime;
+    pTimes[PH_COLLISION] += collision.collideTime;
+
+    start = now;
+    if (collision.batch) {
+        PROFILE_BEGIN(resolve);
+        erv = resolveCollision();
+        ASSERT(erv == ERR_OK, erv);
+        PROFILE_END(resolve);
+    }
+    pTimes[PH_COLLISION] += getProfilerTime() - start;
+
+    return ERR_OK;
+}
+
+/**
+ * Run a single step of the simulation: read the input and simulate it.
+ *
+ * @param  [ in]pTimes Time spent on each phase, in seconds (accumulated)
+ */
+static err _step(double *pTimes) {
+    double start;
+    int elapsed;
     err erv;
     gfmRV rv;
 
-    /* TODO Init all global stuff */
-    erv = initLevel();
-    ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
-    erv = initTest();
-    ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+    start = getProfilerTime();
+    PROFILE_BEGIN(input);
+    erv = updateInput(&input);
+    ASSERT(erv == ERR_OK, erv);
+    handleInput(&input);
+    PROFILE_END(input);
+    rv = gfm_getElapsedTime(&elapsed, game.pCtx);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+    pTimes[PH_INPUT] += getProfilerTime() - start;
 
-    /* Set initial state */
-    game.nextState = ST_TEST;
+    return _simulate(elapsed, pTimes);
+}
 
-    while (gfm_didGetQuitFlag(game.pCtx) != GFMRV_TRUE) {
-        /* Switch state */
-        if (game.nextState != ST_NONE) {
-            switch (game.nextState) {
-                case ST_DUMMY: break;
-                case ST_TEST: break;
-                default: {}
-            }
-            ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+/**
+ * Run game.headlessFrames steps (or until the replay ends, if replaying) as
+ * fast as possible (without waiting for the next frame nor drawing anything)
+ * and print how long they took
+ */
+static err _runHeadless() {
+    double times[PH_MAX];
+    double start, total;
+    int frame, i;
+    err erv;
+
+    memset(times, 0x0, sizeof(times));
+    collision.isTimed = 1;
+    start = getProfilerTime();
+    frame = 0;
+    while (frame < game.headlessFrames && !isReplayDone()) {
+        erv = _step(times);
+        ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+        frame++;
+    }
+    total = getProfilerTime() - start;
+
+    /* Nothing may have run (e.g., on an empty replay) */
+    if (frame == 0 || total <= 0.0) {
+        printf("%i frames in %.3fs\n", frame, total);
+        erv = ERR_OK;
+        goto __ret;
+    }
+    printf("%i frames in %.3fs (%.1f FPS)\n", frame, total, frame / total);
+    i = 0;
+    while (i < PH_MAX) {
+        printf("  %-9s %8.4f ms/frame (%5.1f%%)\n", phaseNames[i]
+                , times[i] * 1000.0 / frame, times[i] * 100.0 / total);
+        i++;
+    }
+
+    erv = ERR_OK;
+__ret:
+    collision.isTimed = 0;
+    return erv;
+}
+
+#if !(defined(__WIN32) || defined(__WIN32__))
+/** Maximum number of steps queued for the simulation thread. If it falls
+ * this far behind, the main thread waits for it */
+#define STEP_QUEUE_LEN 8
+
+/** Everything read from the framework for a single step */
+struct stQueuedStep {
+    /** The buttons' states */
+    inputCtx input;
+    /** Time elapsed since the previous step, in milliseconds */
+    int elapsed;
+};
+typedef struct stQueuedStep queuedStep;
+
+/** Every step queued for the simulation thread */
+static queuedStep stepQueue[STEP_QUEUE_LEN];
+/** First queued step */
+static int stepHead = 0;
+/** Number of queued steps */
+static int stepCount = 0;
+/** Set by the main thread to stop the simulation thread */
+static int simQuit = 0;
+/** Set by the simulation thread when it stops (on error) */
+static int simStopped = 0;
+/** Error that stopped the simulation thread */
+static err simErr = ERR_OK;
+/** Synchronizes the step queue */
+static pthread_mutex_t stepMutex = PTHREAD_MUTEX_INITIALIZER;
+/** Signaled when a step is queued (or on quit) */
+static pthread_cond_t stepQueued = PTHREAD_COND_INITIALIZER;
+/** Signaled when a step is dequeued (or when the simulation stops) */
+static pthread_cond_t stepTaken = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Queue a step for the simulation thread, waiting if the queue is full
+ *
+ * @param  [ in]pInput  The buttons' states for the step
+ * @param  [ in]elapsed Time elapsed since the previous step, in milliseconds
+ * @return              The error that stopped the simulation thread (if any)
+ */
+static err _queueStep(const inputCtx *pInput, int elapsed) {
+    queuedStep *pStep;
+    err erv;
+
+    pthread_mutex_lock(&stepMutex);
+    while (stepCount == STEP_QUEUE_LEN && !simStopped) {
+        pthread_cond_wait(&stepTaken, &stepMutex);
+    }
+    if (!simStopped) {
+        pStep = &stepQueue[(stepHead + stepCount) % STEP_QUEUE_LEN];
+        pStep->input = *pInput;
+        pStep->elapsed = elapsed;
+        stepCount++;
+        pthread_cond_signal(&stepQueued);
+    }
+    erv = simErr;
+    pthread_mutex_unlock(&stepMutex);
+
+    return erv;
+}
+
+/**
+ * Simulate every queued step (with its own input and elapsed time) and publish
+ * its drawable state, until the main thread quits. Other than the main
+ * thread's input copy, the global input and every state are only ever
+ * accessed from here while it's running. The framework's context is never
+ * touched from here, as it isn't thread-safe.
+ */
+static void* _simulationThread(void *pArg) {
+    double times[PH_MAX];
+    snapshot *pSnapshot;
+    unsigned int frame;
+    int elapsed;
+    err erv;
 
-            game.currentState = game.nextState;
-            game.nextState = ST_NONE;
+    setProfilerThread("simulation");
+    memset(times, 0x0, sizeof(times));
+    frame = 0;
+    while (1) {
+        pthread_mutex_lock(&stepMutex);
+        while (stepCount == 0 && !simQuit) {
+            pthread_cond_wait(&stepQueued, &stepMutex);
         }
+        if (simQuit) {
+            pthread_mutex_unlock(&stepMutex);
+            break;
+        }
+        input = stepQueue[stepHead].input;
+        elapsed = stepQueue[stepHead].elapsed;
+        stepHead = (stepHead + 1) % STEP_QUEUE_LEN;
+        stepCount--;
+        pthread_cond_signal(&stepTaken);
+        pthread_mutex_unlock(&stepMutex);
+
+        erv = _simulate(elapsed, times);
+        ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+        frame++;
 
+        pSnapshot = getSnapshotBuffer();
+        pSnapshot->frame = frame;
+        pSnapshot->currentState = game.currentState;
+        erv = ERR_OK;
+        switch (game.currentState) {
+            case ST_DUMMY: break;
+            case ST_TEST: erv = snapshotTest(pSnapshot); break;
+            default: {}
+        }
+        ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+        publishSnapshot();
+    }
+
+    erv = ERR_OK;
+__ret:
+    pthread_mutex_lock(&stepMutex);
+    simErr = erv;
+    simStopped = 1;
+    pthread_cond_signal(&stepTaken);
+    pthread_mutex_unlock(&stepMutex);
+
+    return 0;
+}
+
+/**
+ * Run the game with the simulation on its own thread. The main thread keeps
+ * handling events, reading the input (queued for the simulation) and drawing
+ * the latest published snapshot, as the framework must be used from a
+ * single thread.
+ *
+ * @param  [out]pDidStart Whether the simulation thread could be started (if
+ *                        not, nothing was done)
+ */
+static err _runThreaded(int *pDidStart) {
+    inputCtx mainInput;
+    pthread_t simThread;
+    const snapshot *pSnapshot;
+    int elapsed;
+    err erv;
+    gfmRV rv;
+
+    erv = initSnapshots();
+    ASSERT(erv == ERR_OK, erv);
+
+    /* Copy the handles, so buttons may be read without touching the global
+     * input (which belongs to the simulation from now on) */
+    mainInput = input;
+    stepHead = 0;
+    stepCount = 0;
+    simQuit = 0;
+    simStopped = 0;
+    simErr = ERR_OK;
+    *pDidStart = (pthread_create(&simThread, 0, _simulationThread, 0) == 0);
+    if (!*pDidStart) {
+        cleanSnapshots();
+        return ERR_OK;
+    }
+
+    while (gfm_didGetQuitFlag(game.pCtx) != GFMRV_TRUE && !isReplayDone()) {
         /* Wait for an event */
+        PROFILE_BEGIN(events);
         rv = gfm_handleEvents(game.pCtx);
         ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+        PROFILE_END(events);
 
 #if defined(DEBUG)
-        erv = updateDebugInput();
+        erv = updateDebugInput(&mainInput);
         ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
-        handleDebugInput();
+        handleDebugInput(&mainInput);
 #endif
 
         while (DO_UPDATE()) {
             rv = gfm_fpsCounterUpdateBegin(game.pCtx);
             ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
 
-            erv = updateInput();
+            PROFILE_BEGIN(input);
+            erv = updateInput(&mainInput);
+            ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+            handleInput(&mainInput);
+            PROFILE_END(input);
+            rv = gfm_getElapsedTime(&elapsed, game.pCtx);
+            ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+            erv = _queueStep(&mainInput, elapsed);
             ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
-            handleInput();
 
-            rv = gfm_getElapsedTime(&(game.elapsed), game.pCtx);
+            rv = gfm_fpsCounterUpdateEnd(game.pCtx);
             ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
 
-            /* Update the current state */
-            switch (game.currentState) {
+            DEBUG_STEP();
+        }
+
+        while (gfm_isDrawing(game.pCtx) == GFMRV_TRUE) {
+            rv = gfm_drawBegin(game.pCtx);
+            ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+
+            /* Render the latest simulated step. The quadtrees belong to the
+             * simulation, so they aren't drawn */
+            PROFILE_BEGIN(draw);
+            pSnapshot = getLatestSnapshot();
+            erv = ERR_OK;
+            switch (pSnapshot->currentState) {
                 case ST_DUMMY: break;
-                case ST_TEST: erv = updateTest(); break;
+                case ST_TEST: erv = drawTestSnapshot(pSnapshot); break;
                 default: {}
             }
             ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+            PROFILE_END(draw);
+
+            rv = gfm_drawRenderInfo(game.pCtx, 0, 0/*x*/, 24/*y*/, 0);
+            ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+
+            PROFILE_BEGIN(drawEnd);
+            rv = gfm_drawEnd(game.pCtx);
+            ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+            PROFILE_END(drawEnd);
+        }
+    }
+
+    erv = ERR_OK;
+__ret:
+    pthread_mutex_lock(&stepMutex);
+    simQuit = 1;
+    pthread_cond_signal(&stepQueued);
+    pthread_mutex_unlock(&stepMutex);
+    pthread_join(simThread, 0);
+    if (erv == ERR_OK) {
+        erv = simErr;
+    }
+    cleanTestRenderer();
+    cleanSnapshots();
+
+    return erv;
+}
+#endif
+
+/** Run the main loop until the game is closed */
+err mainloop() {
+    double times[PH_MAX];
+    err erv;
+    gfmRV rv;
+
+    setProfilerThread("main");
+
+    /* TODO Init all global stuff */
+    erv = initLevel();
+    ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+
+    /* Set initial state */
+    game.nextState = ST_TEST;
+    memset(times, 0x0, sizeof(times));
+
+    if (game.headlessFrames > 0) {
+        erv = _runHeadless();
+        goto __ret;
+    }
+#if !(defined(__WIN32) || defined(__WIN32__))
+    if (game.threaded) {
+        int didStart;
+
+        erv = _runThreaded(&didStart);
+        /* Otherwise, simply run everything on this thread */
+        if (didStart || erv != ERR_OK) {
+            goto __ret;
+        }
+    }
+#endif
+
+    while (gfm_didGetQuitFlag(game.pCtx) != GFMRV_TRUE && !isReplayDone()) {
+        /* Wait for an event */
+        PROFILE_BEGIN(events);
+        rv = gfm_handleEvents(game.pCtx);
+        ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+        PROFILE_END(events);
+
+#if defined(DEBUG)
+        erv = updateDebugInput(&input);
+        ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+        handleDebugInput(&input);
+#endif
+
+        while (DO_UPDATE()) {
+            rv = gfm_fpsCounterUpdateBegin(game.pCtx);
+            ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+
+            /* Phases are only timed on headless mode */
+            erv = _step(times);
+            ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
 
             rv = gfm_fpsCounterUpdateEnd(game.pCtx);
             ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
@@ -84,19 +543,16 @@ err mainloop() {
             ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
 
             /* Render the current state */
+            PROFILE_BEGIN(draw);
             switch (game.currentState) {
                 case ST_DUMMY: break;
                 case ST_TEST: erv = drawTest(); break;
                 default: {}
             }
             ASSERT_TO(erv == ERR_OK, NOOP(), __ret);
+            PROFILE_END(draw);
 
             if (IS_QUADTREE_VISIBLE()) {
-                rv = gfmQuadtree_drawBounds(collision.pStaticQt, game.pCtx, 0);
-                ASSERT_TO(rv == GFMRV_QUADTREE_EMPTY
-                        || rv == GFMRV_QUADTREE_NOT_INITIALIZED
-                        || rv == GFMRV_ARGUMENTS_BAD
-                        || rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
                 rv = gfmQuadtree_drawBounds(collision.pQt, game.pCtx, 0);
                 ASSERT_TO(rv == GFMRV_QUADTREE_EMPTY
                         || rv == GFMRV_QUADTREE_NOT_INITIALIZED
@@ -107,14 +563,17 @@ err mainloop() {
             rv = gfm_drawRenderInfo(game.pCtx, 0, 0/*x*/, 24/*y*/, 0);
             ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
 
+            PROFILE_BEGIN(drawEnd);
             rv = gfm_drawEnd(game.pCtx);
             ASSERT_TO(rv == GFMRV_OK, erv = ERR_GFMERR, __ret);
+            PROFILE_END(drawEnd);
         }
     }
 
     erv = ERR_OK;
 __ret:
     /* TODO Free all global stuff */
+    cleanTestRenderer();
     cleanTest();
     cleanLevel();
 
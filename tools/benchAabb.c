@@ -0,0 +1,271 @@
+/**
+ * @file tools/benchAabb.c
+ *
+ * Micro-benchmark comparing the batched AABB kernel (src/base/aabb.c) against
+ * testing each pair through GFraMe (i.e., gfmObject_isOverlaping) and against
+ * a plain scalar loop over the same arrays.
+ *
+ * As on a sweep, objects are sorted by their horizontal position and each one
+ * is tested against the following BENCH_CANDIDATES objects. The kernel's
+ * result is also checked against the scalar loop.
+ *
+ * Usage: benchAabb [iterations]
+ */
+#include <base/aabb.h>
+#include <base/error.h>
+
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmObject.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Number of objects being benchmarked */
+#define BENCH_SIZES \
+  X(1000) \
+  X(10000) \
+  X(100000)
+
+/** Number of candidates tested against each object */
+#define BENCH_CANDIDATES 64
+
+/** Retrieve the current time, in seconds */
+static double _now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Order edges by their value */
+static int _compareInts(const void *pA, const void *pB) {
+    return *(const int*)pA - *(const int*)pB;
+}
+
+/**
+ * Count every overlap through GFraMe
+ *
+ * @param  [ in]ppObjects  The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static int _runObjects(gfmObject **ppObjects, int numObjects) {
+    int i, j, last, count;
+
+    count = 0;
+    i = 0;
+    while (i < numObjects) {
+        last = i + 1 + BENCH_CANDIDATES;
+        if (last > numObjects) {
+            last = numObjects;
+        }
+        j = i + 1;
+        while (j < last) {
+            if (gfmObject_isOverlaping(ppObjects[i], ppObjects[j])
+                    == GFMRV_TRUE) {
+                count++;
+            }
+            j++;
+        }
+        i++;
+    }
+
+    return count;
+}
+
+/**
+ * Count every overlap, testing one pair at a time
+ *
+ * @param  [ in]pBoxes     The objects' bounds
+ * @param  [ in]numObjects How many objects there are
+ */
+static int _runScalar(const aabbArrays *pBoxes, int numObjects) {
+    int i, j, last, count;
+
+    count = 0;
+    i = 0;
+    while (i < numObjects) {
+        last = i + 1 + BENCH_CANDIDATES;
+        if (last > numObjects) {
+            last = numObjects;
+        }
+        j = i + 1;
+        while (j < last) {
+            if (pBoxes->pRight[j] > pBoxes->pLeft[i]
+                    && pBoxes->pRight[i] > pBoxes->pLeft[j]
+                    && pBoxes->pBottom[j] > pBoxes->pTop[i]
+                    && pBoxes->pBottom[i] > pBoxes->pTop[j]) {
+                count++;
+            }
+            j++;
+        }
+        i++;
+    }
+
+    return count;
+}
+
+/**
+ * Count every overlap through the kernel
+ *
+ * @param  [ in]pBoxes     The objects' bounds
+ * @param  [ in]numObjects How many objects there are
+ */
+static int _runKernel(const aabbArrays *pBoxes, int numObjects) {
+    int i, j, last, count;
+
+    count = 0;
+    i = 0;
+    while (i < numObjects) {
+        last = i + 1 + BENCH_CANDIDATES;
+        if (last > numObjects) {
+            last = numObjects;
+        }
+        j = i + 1;
+        while (j < last) {
+            int num;
+
+            num = last - j;
+            if (num > AABB_BATCH_LEN) {
+                num = AABB_BATCH_LEN;
+            }
+            count += __builtin_popcount(overlapAabbBatch(pBoxes, j, num
+                    , pBoxes->pLeft[i], pBoxes->pTop[i], pBoxes->pRight[i]
+                    , pBoxes->pBottom[i]));
+            j += num;
+        }
+        i++;
+    }
+
+    return count;
+}
+
+/** Benchmark every path with a number of objects */
+static int _bench(int numObjects, int iterations) {
+    gfmObject **ppObjects;
+    aabbArrays boxes;
+    int *pBuf;
+    double objTime, scalarTime, kernelTime, start, numTests;
+    int i, ret, objCount, scalarCount, kernelCount, worldSize;
+
+    ret = 1;
+    pBuf = malloc(sizeof(int) * numObjects * 4);
+    ppObjects = calloc(numObjects, sizeof(gfmObject*));
+    if (!pBuf || !ppObjects) {
+        fprintf(stderr, "Failed to alloc %i objects\n", numObjects);
+        goto __ret;
+    }
+    boxes.pLeft = pBuf;
+    boxes.pTop = pBuf + numObjects;
+    boxes.pRight = pBuf + numObjects * 2;
+    boxes.pBottom = pBuf + numObjects * 3;
+
+    /* Keep the same density on every size, sorted as if they were swept */
+    srand(numObjects);
+    worldSize = 1;
+    while (worldSize * worldSize < numObjects * 256) {
+        worldSize *= 2;
+    }
+    i = 0;
+    while (i < numObjects) {
+        boxes.pLeft[i] = rand() % worldSize;
+        i++;
+    }
+    qsort(boxes.pLeft, numObjects, sizeof(int), &_compareInts);
+    i = 0;
+    while (i < numObjects) {
+        boxes.pTop[i] = rand() % worldSize;
+        boxes.pRight[i] = boxes.pLeft[i] + 4 + rand() % 13;
+        boxes.pBottom[i] = boxes.pTop[i] + 4 + rand() % 13;
+        if (gfmObject_getNew(&ppObjects[i]) != GFMRV_OK) {
+            fprintf(stderr, "Failed to alloc %i objects\n", numObjects);
+            goto __ret;
+        }
+        gfmObject_init(ppObjects[i], boxes.pLeft[i], boxes.pTop[i]
+                , boxes.pRight[i] - boxes.pLeft[i]
+                , boxes.pBottom[i] - boxes.pTop[i], 0, 0);
+        i++;
+    }
+
+    objTime = 0;
+    scalarTime = 0;
+    kernelTime = 0;
+    objCount = 0;
+    scalarCount = 0;
+    kernelCount = 0;
+    i = 0;
+    while (i < iterations) {
+        start = _now();
+        objCount = _runObjects(ppObjects, numObjects);
+        objTime += _now() - start;
+
+        start = _now();
+        scalarCount = _runScalar(&boxes, numObjects);
+        scalarTime += _now() - start;
+
+        start = _now();
+        kernelCount = _runKernel(&boxes, numObjects);
+        kernelTime += _now() - start;
+        i++;
+    }
+
+    if (kernelCount != scalarCount) {
+        fprintf(stderr, "Mismatch with %i objects! (%i overlaps, expected %i)"
+                "\n", numObjects, kernelCount, scalarCount);
+        goto __ret;
+    }
+
+    /* Throughput, in millions of tests per second */
+    numTests = (double)numObjects * BENCH_CANDIDATES * iterations / 1e6;
+    printf("%6i objects (%6i overlaps)  gfmObject: %8.2f Mtests/s"
+            "  scalar: %8.2f Mtests/s  kernel: %8.2f Mtests/s  speedup:"
+            " %6.2fx\n", numObjects, objCount, numTests / objTime
+            , numTests / scalarTime, numTests / kernelTime
+            , objTime / kernelTime);
+    ret = 0;
+__ret:
+    if (ppObjects) {
+        i = 0;
+        while (i < numObjects) {
+            gfmObject_free(&ppObjects[i]);
+            i++;
+        }
+    }
+    free(ppObjects);
+    free(pBuf);
+
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations;
+
+    iterations = 20;
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+#if defined(__AVX2__)
+    printf("Kernel: AVX2\n");
+#elif defined(__SSE2__)
+    printf("Kernel: SSE2\n");
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    printf("Kernel: NEON\n");
+#else
+    printf("Kernel: scalar\n");
+#endif
+
+#define X(numObjects) \
+    if (_bench(numObjects, iterations) != 0) { \
+        return 1; \
+    }
+    BENCH_SIZES
+#undef X
+
+    return 0;
+}
+
@@ -0,0 +1,543 @@
+/**
+ * @file tools/benchBroadphase.c
+ *
+ * Benchmark comparing GFraMe's quadtree against the spatial hash
+ * (src/base/spatialHash.c), the multi-threaded bands
+ * (src/base/bandBroadphase.c) and the incremental hash
+ * (src/base/incrementalHash.c), as dynamic broadphases. Every structure but
+ * the incremental hash is rebuilt every frame (as done by the game), while
+ * objects that never move are kept asleep on the latter. Every overlapping
+ * pair is retrieved.
+ *
+ * Objects are placed on a few distributions:
+ *   - uniform: spread over the whole world
+ *   - clustered: packed around a few points
+ *   - static: mostly laid on the tile grid (and never moving), with a few
+ *     wandering objects
+ *   - sleeping: just like static, but with even fewer wandering objects. The
+ *     incremental hash's cost should follow the number of moving objects,
+ *     instead of the total
+ *
+ * Objects laid on the grid never overlap each other, so every broadphase
+ * reports the same pairs. Those are also checked against a brute force
+ * search (for every structure but the quadtree).
+ *
+ * Usage: benchBroadphase [frames]
+ */
+#include <base/bandBroadphase.h>
+#include <base/collision.h>
+#include <base/incrementalHash.h>
+#include <base/spatialHash.h>
+
+#include <GFraMe/gfmError.h>
+#include <GFraMe/gfmObject.h>
+#include <GFraMe/gfmQuadtree.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Dimensions of the world, in pixels */
+#define WORLD_WIDTH  1024
+#define WORLD_HEIGHT 1024
+/** Number of clusters, on the clustered distribution */
+#define NUM_CLUSTERS 8
+/** One in how many objects moves, on the static and sleeping distributions */
+#define STATIC_MOVERS   10
+#define SLEEPING_MOVERS 64
+
+/** Number of objects being benchmarked */
+#define BENCH_SIZES \
+  X(256) \
+  X(1024) \
+  X(4096)
+
+/** Distributions being benchmarked */
+#define DISTRIBUTION_LIST \
+  X(uniform) \
+  X(clustered) \
+  X(static) \
+  X(sleeping)
+
+enum enDistribution {
+#define X(name) DIST_##name,
+    DISTRIBUTION_LIST
+#undef X
+    DIST_MAX
+};
+typedef enum enDistribution distribution;
+
+static const char *distributionNames[] = {
+#define X(name) #name,
+    DISTRIBUTION_LIST
+#undef X
+};
+
+/** An object and its bounds */
+struct stBenchObject {
+    gfmObject *pObject;
+    int x;
+    int y;
+    int width;
+    int height;
+    /** Whether the object moves every frame */
+    int isDynamic;
+};
+typedef struct stBenchObject benchObject;
+
+/** Retrieve the current time, in seconds */
+static double _now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Retrieve a random number in the range [min, max] */
+static int _random(int min, int max) {
+    return min + rand() % (max - min + 1);
+}
+
+/**
+ * Keep an object within the world
+ *
+ * @param  [ in]pObj The object
+ */
+static void _clamp(benchObject *pObj) {
+    if (pObj->x < 0) {
+        pObj->x = 0;
+    }
+    else if (pObj->x + pObj->width > WORLD_WIDTH) {
+        pObj->x = WORLD_WIDTH - pObj->width;
+    }
+    if (pObj->y < 0) {
+        pObj->y = 0;
+    }
+    else if (pObj->y + pObj->height > WORLD_HEIGHT) {
+        pObj->y = WORLD_HEIGHT - pObj->height;
+    }
+}
+
+/**
+ * Place every object according to a distribution
+ *
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ * @param  [ in]dist       The distribution
+ */
+static void _distribute(benchObject *pObjs, int numObjects, distribution dist) {
+    int clusterX[NUM_CLUSTERS], clusterY[NUM_CLUSTERS];
+    int i, movers;
+
+    i = 0;
+    while (i < NUM_CLUSTERS) {
+        clusterX[i] = _random(64, WORLD_WIDTH - 64);
+        clusterY[i] = _random(64, WORLD_HEIGHT - 64);
+        i++;
+    }
+
+    movers = STATIC_MOVERS;
+    if (dist == DIST_sleeping) {
+        movers = SLEEPING_MOVERS;
+    }
+
+    i = 0;
+    while (i < numObjects) {
+        benchObject *pObj;
+
+        pObj = &pObjs[i];
+        pObj->width = _random(4, 16);
+        pObj->height = _random(4, 16);
+        pObj->isDynamic = 1;
+        switch (dist) {
+            case DIST_uniform: {
+                pObj->x = _random(0, WORLD_WIDTH);
+                pObj->y = _random(0, WORLD_HEIGHT);
+            } break;
+            case DIST_clustered: {
+                pObj->x = clusterX[i % NUM_CLUSTERS] + _random(-48, 48);
+                pObj->y = clusterY[i % NUM_CLUSTERS] + _random(-48, 48);
+            } break;
+            case DIST_static:
+            case DIST_sleeping: {
+                if (i % movers != 0) {
+                    /* Tiles (and other static objects) never overlap */
+                    pObj->x = ((i * 2) % (WORLD_WIDTH / 8)) * 8;
+                    pObj->y = ((i * 2) / (WORLD_WIDTH / 8)) * 8;
+                    pObj->width = 8;
+                    pObj->height = 8;
+                    pObj->isDynamic = 0;
+                }
+                else {
+                    pObj->x = _random(0, WORLD_WIDTH);
+                    pObj->y = _random(0, WORLD_HEIGHT);
+                }
+            } break;
+            default: {}
+        }
+        _clamp(pObj);
+        gfmObject_init(pObj->pObject, pObj->x, pObj->y, pObj->width
+                , pObj->height, 0, 0);
+        i++;
+    }
+}
+
+/**
+ * Move every dynamic object a little
+ *
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static void _move(benchObject *pObjs, int numObjects) {
+    int i;
+
+    i = 0;
+    while (i < numObjects) {
+        benchObject *pObj;
+
+        pObj = &pObjs[i];
+        if (pObj->isDynamic) {
+            pObj->x += _random(-2, 2);
+            pObj->y += _random(-2, 2);
+            _clamp(pObj);
+            gfmObject_setPosition(pObj->pObject, pObj->x, pObj->y);
+        }
+        i++;
+    }
+}
+
+/**
+ * Count every overlapping pair through brute force
+ *
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static int _bruteForce(benchObject *pObjs, int numObjects) {
+    int i, j, count;
+
+    count = 0;
+    i = 0;
+    while (i < numObjects) {
+        j = i + 1;
+        while (j < numObjects) {
+            if (pObjs[i].x < pObjs[j].x + pObjs[j].width
+                    && pObjs[j].x < pObjs[i].x + pObjs[i].width
+                    && pObjs[i].y < pObjs[j].y + pObjs[j].height
+                    && pObjs[j].y < pObjs[i].y + pObjs[i].height) {
+                count++;
+            }
+            j++;
+        }
+        i++;
+    }
+
+    return count;
+}
+
+/**
+ * Collide every object on the quadtree and count the overlapping pairs
+ *
+ * @param  [out]pCount     How many pairs were reported
+ * @param  [ in]pQt        The quadtree
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static err _runQuadtree(int *pCount, gfmQuadtreeRoot *pQt, benchObject *pObjs
+        , int numObjects) {
+    int i;
+    gfmRV rv;
+
+    rv = gfmQuadtree_initRoot(pQt, -8, -8, WORLD_WIDTH + 16, WORLD_HEIGHT + 16
+            , QT_MAX_DEPTH, QT_MAX_NODES);
+    ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+
+    *pCount = 0;
+    i = 0;
+    while (i < numObjects) {
+        rv = gfmQuadtree_collideObject(pQt, pObjs[i].pObject);
+        while (rv == GFMRV_QUADTREE_OVERLAPED) {
+            gfmObject *pObj1, *pObj2;
+
+            rv = gfmQuadtree_getOverlaping(&pObj1, &pObj2, pQt);
+            ASSERT(rv == GFMRV_OK, ERR_GFMERR);
+            (*pCount)++;
+            rv = gfmQuadtree_continue(pQt);
+        }
+        ASSERT(rv == GFMRV_QUADTREE_DONE, ERR_GFMERR);
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Collide every object on the spatial hash and count the overlapping pairs
+ *
+ * @param  [out]pCount     How many pairs were reported
+ * @param  [ in]pHash      The spatial hash
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static err _runSpatialHash(int *pCount, spatialHash *pHash
+        , benchObject *pObjs, int numObjects) {
+    int i;
+    err erv;
+
+    resetSpatialHash(pHash);
+
+    *pCount = 0;
+    i = 0;
+    while (i < numObjects) {
+        int didOverlap;
+
+        erv = collideSpatialHash(&didOverlap, pHash, pObjs[i].pObject, i
+                , 1, 1);
+        ASSERT(erv == ERR_OK, erv);
+        while (didOverlap) {
+            int id1, id2;
+
+            getSpatialHashOverlap(&id1, &id2, pHash);
+            (*pCount)++;
+            didOverlap = continueSpatialHash(pHash);
+        }
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Find every overlapping pair on the bands
+ *
+ * @param  [out]pCount     How many pairs were reported
+ * @param  [ in]pBP        The bands
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static err _runBands(int *pCount, bandBroadphase *pBP, benchObject *pObjs
+        , int numObjects) {
+    int i;
+    err erv;
+
+    resetBandBroadphase(pBP);
+
+    i = 0;
+    while (i < numObjects) {
+        erv = addBandObject(pBP, pObjs[i].pObject, i, 1, 1);
+        ASSERT(erv == ERR_OK, erv);
+        i++;
+    }
+    erv = findBandPairs(pBP);
+    ASSERT(erv == ERR_OK, erv);
+    *pCount = pBP->numPairs;
+
+    return ERR_OK;
+}
+
+/**
+ * Put every object that never moves to sleep on the incremental hash
+ *
+ * @param  [ in]pHash      The incremental hash
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static err _sleepIncremental(incrementalHash *pHash, benchObject *pObjs
+        , int numObjects) {
+    int i;
+    err erv;
+
+    i = 0;
+    while (i < numObjects) {
+        if (!pObjs[i].isDynamic) {
+            erv = sleepIncrementalObject(pHash, pObjs[i].pObject, 1, 1);
+            ASSERT(erv == ERR_OK, erv);
+        }
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+/**
+ * Collide every moving object on the incremental hash and count the
+ * overlapping pairs (sleeping objects are only reported)
+ *
+ * @param  [out]pCount     How many pairs were reported
+ * @param  [ in]pHash      The incremental hash
+ * @param  [ in]pObjs      The objects
+ * @param  [ in]numObjects How many objects there are
+ */
+static err _runIncremental(int *pCount, incrementalHash *pHash
+        , benchObject *pObjs, int numObjects) {
+    int i;
+    err erv;
+
+    beginIncrementalFrame(pHash);
+
+    *pCount = 0;
+    i = 0;
+    while (i < numObjects) {
+        int didOverlap;
+
+        if (!pObjs[i].isDynamic) {
+            i++;
+            continue;
+        }
+        erv = collideIncrementalHash(&didOverlap, pHash, pObjs[i].pObject, i
+                , 1, 1);
+        ASSERT(erv == ERR_OK, erv);
+        while (didOverlap) {
+            gfmObject *pObj2;
+            int id1, id2;
+
+            getIncrementalOverlap(&id1, &id2, &pObj2, pHash);
+            (*pCount)++;
+            didOverlap = continueIncrementalHash(pHash);
+        }
+        i++;
+    }
+
+    return ERR_OK;
+}
+
+/** Benchmark every broadphase with a number of objects on a distribution */
+static int _bench(int numObjects, distribution dist, int frames) {
+    benchObject *pObjs;
+    gfmQuadtreeRoot *pQt;
+    spatialHash hash;
+    bandBroadphase bands;
+    incrementalHash incremental;
+    double qtTime, hashTime, bandsTime, incTime, start;
+    int i, ret, qtCount, hashCount, bandsCount, incCount, expected;
+    err erv;
+
+    pQt = 0;
+    ret = 1;
+    initSpatialHash(&hash);
+    initBandBroadphase(&bands);
+    initIncrementalHash(&incremental);
+    pObjs = calloc(numObjects, sizeof(benchObject));
+    if (!pObjs || gfmQuadtree_getNew(&pQt) != GFMRV_OK) {
+        fprintf(stderr, "Failed to alloc %i objects\n", numObjects);
+        goto __ret;
+    }
+    i = 0;
+    while (i < numObjects) {
+        if (gfmObject_getNew(&pObjs[i].pObject) != GFMRV_OK) {
+            fprintf(stderr, "Failed to alloc %i objects\n", numObjects);
+            goto __ret;
+        }
+        i++;
+    }
+
+    srand(numObjects + dist);
+    _distribute(pObjs, numObjects, dist);
+    if (_sleepIncremental(&incremental, pObjs, numObjects) != ERR_OK) {
+        fprintf(stderr, "Failed to put %i objects to sleep\n", numObjects);
+        goto __ret;
+    }
+
+    qtTime = 0;
+    hashTime = 0;
+    bandsTime = 0;
+    incTime = 0;
+    qtCount = 0;
+    hashCount = 0;
+    bandsCount = 0;
+    incCount = 0;
+    i = 0;
+    while (i < frames) {
+        _move(pObjs, numObjects);
+
+        start = _now();
+        erv = _runQuadtree(&qtCount, pQt, pObjs, numObjects);
+        qtTime += _now() - start;
+        if (erv != ERR_OK) {
+            fprintf(stderr, "Quadtree failed on frame %i\n", i);
+            goto __ret;
+        }
+
+        start = _now();
+        erv = _runSpatialHash(&hashCount, &hash, pObjs, numObjects);
+        hashTime += _now() - start;
+        if (erv != ERR_OK) {
+            fprintf(stderr, "Spatial hash failed on frame %i\n", i);
+            goto __ret;
+        }
+
+        start = _now();
+        erv = _runBands(&bandsCount, &bands, pObjs, numObjects);
+        bandsTime += _now() - start;
+        if (erv != ERR_OK) {
+            fprintf(stderr, "Bands failed on frame %i\n", i);
+            goto __ret;
+        }
+
+        start = _now();
+        erv = _runIncremental(&incCount, &incremental, pObjs, numObjects);
+        incTime += _now() - start;
+        if (erv != ERR_OK) {
+            fprintf(stderr, "Incremental hash failed on frame %i\n", i);
+            goto __ret;
+        }
+        i++;
+    }
+
+    expected = _bruteForce(pObjs, numObjects);
+    if (hashCount != expected || bandsCount != expected
+            || incCount != expected) {
+        fprintf(stderr, "Mismatch with %i %s objects! (%i/%i/%i pairs,"
+                " expected %i)\n", numObjects, distributionNames[dist]
+                , hashCount, bandsCount, incCount, expected);
+        goto __ret;
+    }
+
+    printf("%5i %-9s quadtree: %8.3f ms (%5i pairs)  hash: %8.3f ms"
+            " (%6.2fx)  bands: %8.3f ms (%6.2fx)  incremental: %8.3f ms"
+            " (%6.2fx, %i awake)\n", numObjects, distributionNames[dist]
+            , qtTime * 1e3 / frames, qtCount, hashTime * 1e3 / frames
+            , qtTime / hashTime, bandsTime * 1e3 / frames, qtTime / bandsTime
+            , incTime * 1e3 / frames, qtTime / incTime, incremental.numAwake);
+    ret = 0;
+__ret:
+    if (pObjs) {
+        i = 0;
+        while (i < numObjects) {
+            gfmObject_free(&pObjs[i].pObject);
+            i++;
+        }
+    }
+    free(pObjs);
+    gfmQuadtree_free(&pQt);
+    freeSpatialHash(&hash);
+    freeBandBroadphase(&bands);
+    freeIncrementalHash(&incremental);
+
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    int frames;
+
+    frames = 60;
+    if (argc > 1) {
+        frames = atoi(argv[1]);
+    }
+    if (frames <= 0) {
+        fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+#define X(numObjects) \
+    if (_bench(numObjects, DIST_uniform, frames) != 0 \
+            || _bench(numObjects, DIST_clustered, frames) != 0 \
+            || _bench(numObjects, DIST_static, frames) != 0 \
+            || _bench(numObjects, DIST_sleeping, frames) != 0) { \
+        return 1; \
+    }
+    BENCH_SIZES
+#undef X
+
+    return 0;
+}
+
@@ -0,0 +1,269 @@
+/**
+ * @file tools/benchMirror.c
+ *
+ * Micro-benchmark comparing the table-driven mirror kernel (src/ld37/mirror.c)
+ * against the original switch-based implementation, on maps of increasing
+ * sizes. The kernel is run on chunked tiles, exactly as stored on binary
+ * levels (i.e., split into chunks and on the narrowest possible type). Every
+ * result is also checked against the original implementation, and all 8
+ * orientations are checked tile by tile against mirrorPosition and
+ * mirrorTile. The kernel is picked when compiling, so this must be built both
+ * with and without AVX2 to check both of them ('make bench AVX2=yes' does).
+ *
+ * Usage: benchMirror [iterations]
+ */
+#include <ld37/level.h>
+#include <ld37/levelFile.h>
+#include <ld37/mirror.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Map sizes being benchmarked */
+#define BENCH_SIZES \
+  X(40, 30) \
+  X(256, 256) \
+  X(1024, 1024) \
+  X(4096, 4096)
+
+/** Tiles used to fill the maps (every tile with symmetry plus some others) */
+static const int benchTiles[] = {
+    -1, -1, -1, -1, -1, -1, 64, 65, 66, 80, 81, 82, 96, 97, 98, 0, 17, 254
+};
+
+/** The original implementation (from src/ld37/level.c) */
+static inline int _recalculateTile(int tile, levelOrientation orientation) {
+    switch (tile) {
+        case 64: /* top left */
+            if (orientation == LO_HORIZONTAL_MIRROR)    return 66;
+            else if (orientation == LO_VERTICAL_MIRROR) return 96;
+            else if (orientation == LO_MIRROR_BOTH)     return 98;
+            break;
+        case 65: /* top */
+            if (orientation & LO_VERTICAL_MIRROR) return 97;
+            break;
+        case 66: /* top right */
+            if (orientation == LO_HORIZONTAL_MIRROR)    return 64;
+            else if (orientation == LO_VERTICAL_MIRROR) return 98;
+            else if (orientation == LO_MIRROR_BOTH)     return 96;
+            break;
+        case 80: /* left */
+            if (orientation & LO_HORIZONTAL_MIRROR) return 82;
+            break;
+        case 81: /* center */
+            break;
+        case 82: /* right */
+            if (orientation & LO_HORIZONTAL_MIRROR) return 80;
+            break;
+        case 96: /* bottom left */
+            if (orientation == LO_HORIZONTAL_MIRROR)    return 98;
+            else if (orientation == LO_VERTICAL_MIRROR) return 64;
+            else if (orientation == LO_MIRROR_BOTH)     return 66;
+            break;
+        case 97: /* bottom */
+            if (orientation & LO_VERTICAL_MIRROR) return 65;
+            break;
+        case 98: /* bottom right */
+            if (orientation == LO_HORIZONTAL_MIRROR)    return 96;
+            else if (orientation == LO_VERTICAL_MIRROR) return 66;
+            else if (orientation == LO_MIRROR_BOTH)     return 64;
+            break;
+        default: return tile;
+    }
+    return tile;
+}
+
+/** The original mirror loops (from initLevel, on src/ld37/level.c) */
+static void _legacyMirror(int *pHorizontal, int *pVertical, int *pBoth
+        , const int *pBase, int width, int height) {
+    int i;
+
+    i = 0;
+    while (i < height) {
+        int j = 0;
+        while (j < width) {
+            int tile;
+
+            tile = _recalculateTile(pBase[j + i * width]
+                    , LO_HORIZONTAL_MIRROR);
+            pHorizontal[width - j - 1 + i * width] = tile;
+
+            tile = _recalculateTile(pBase[j + i * width]
+                    , LO_VERTICAL_MIRROR);
+            pVertical[j + (height - i - 1) * width] = tile;
+            j++;
+        }
+        i++;
+    }
+
+    i = 0;
+    while (i < height * width) {
+        int tile;
+
+        tile = _recalculateTile(pBase[i], LO_MIRROR_BOTH);
+        pBoth[height * width - i - 1] = tile;
+        i++;
+    }
+}
+
+/**
+ * Check every orientation generated by the kernel against mirrorPosition and
+ * mirrorTile
+ *
+ * @param  [ in]pDst   Buffer for the orientation (as big as the map)
+ * @param  [ in]pTiles The map's chunks
+ * @param  [ in]pBase  The map, in its default orientation
+ * @param  [ in]width  The map's width in tiles
+ * @param  [ in]height The map's height in tiles
+ * @return             Whether every orientation matched
+ */
+static int _checkOrientations(int *pDst, const levelTiles *pTiles
+        , const int *pBase, int width, int height) {
+    levelOrientation orientation;
+
+    orientation = LO_DEFAULT;
+    while (orientation < LO_MAX) {
+        int x, y, dstWidth;
+
+        dstWidth = width;
+        if (orientation & LO_TRANSPOSE) {
+            dstWidth = height;
+        }
+        mirrorTilemap(pDst, pTiles, orientation);
+
+        y = 0;
+        while (y < height) {
+            x = 0;
+            while (x < width) {
+                int dstX, dstY, tile;
+
+                mirrorPosition(&dstX, &dstY, x, y, width, height
+                        , orientation);
+                tile = mirrorTile(pBase[x + y * width], orientation);
+                if (pDst[dstX + dstY * dstWidth] != tile) {
+                    fprintf(stderr, "Mismatch on orientation %i of a %ix%i"
+                            " map, at (%i, %i)!\n", orientation, width, height
+                            , x, y);
+                    return 0;
+                }
+                x++;
+            }
+            y++;
+        }
+        orientation++;
+    }
+
+    return 1;
+}
+
+/** Retrieve the current time, in seconds */
+static double _now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Benchmark both implementations on a map of the given dimensions */
+static int _bench(int width, int height, int iterations) {
+    int *pBase, *pLegacy, *pTable;
+    double legacyTime, tableTime, start;
+    levelTiles tiles;
+    size_t numTiles;
+    int i, ret;
+
+    numTiles = (size_t)width * height;
+    pBase = malloc(sizeof(int) * numTiles);
+    pLegacy = malloc(sizeof(int) * numTiles * 3);
+    pTable = malloc(sizeof(int) * numTiles * 3);
+    memset(&tiles, 0x0, sizeof(levelTiles));
+    ret = 1;
+    if (!pBase || !pLegacy || !pTable) {
+        fprintf(stderr, "Failed to alloc a %ix%i map\n", width, height);
+        goto __ret;
+    }
+
+    srand(width * height);
+    i = 0;
+    while ((size_t)i < numTiles) {
+        pBase[i] = benchTiles[rand()
+                % (sizeof(benchTiles) / sizeof(benchTiles[0]))];
+        i++;
+    }
+    if (initLevelTiles(&tiles, pBase, width, height) != ERR_OK) {
+        fprintf(stderr, "Failed to chunk a %ix%i map\n", width, height);
+        goto __ret;
+    }
+
+    /* Each iteration generates every orientation (as initLevel used to) */
+    start = _now();
+    i = 0;
+    while (i < iterations) {
+        _legacyMirror(pLegacy, pLegacy + numTiles, pLegacy + numTiles * 2
+                , pBase, width, height);
+        i++;
+    }
+    legacyTime = (_now() - start) / iterations;
+
+    start = _now();
+    i = 0;
+    while (i < iterations) {
+        mirrorTilemap(pTable, &tiles, LO_HORIZONTAL_MIRROR);
+        mirrorTilemap(pTable + numTiles, &tiles, LO_VERTICAL_MIRROR);
+        mirrorTilemap(pTable + numTiles * 2, &tiles, LO_MIRROR_BOTH);
+        i++;
+    }
+    tableTime = (_now() - start) / iterations;
+
+    if (memcmp(pLegacy, pTable, sizeof(int) * numTiles * 3) != 0) {
+        fprintf(stderr, "Mismatch on a %ix%i map!\n", width, height);
+        goto __ret;
+    }
+    if (!_checkOrientations(pTable, &tiles, pBase, width, height)) {
+        goto __ret;
+    }
+
+    printf("%5ix%-5i legacy: %10.3f ms  chunked (%i byte): %10.3f ms"
+            "  speedup: %6.2fx\n"
+            , width, height, legacyTime * 1e3, tiles.bytesPerTile
+            , tableTime * 1e3, legacyTime / tableTime);
+    ret = 0;
+__ret:
+    free(pBase);
+    freeLevelTiles(&tiles);
+    free(pLegacy);
+    free(pTable);
+
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations;
+
+    iterations = 10;
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    initMirrorTables();
+#if defined(__AVX2__)
+    printf("Mirror kernel: AVX2\n");
+#else
+    printf("Mirror kernel: scalar\n");
+#endif
+
+#define X(width, height) \
+    if (_bench(width, height, iterations) != 0) { \
+        return 1; \
+    }
+    BENCH_SIZES
+#undef X
+
+    return 0;
+}
@@ -0,0 +1,377 @@
+/**
+ * @file tools/mapconv.c
+ *
+ * Convert a text map (either a GFraMe .gfm or a Tiled .tmx) into the binary
+ * level format described on include/ld37/levelFile.h.
+ *
+ * Usage: mapconv <input.gfm|input.tmx> <output.bin>
+ *
+ * Only the tile types and the tiles themselves are converted. Types are resolved
+ * through conf/tiletype_list.h and .gfm maps are parsed by the same code the
+ * game uses when a binary level is missing (see src/ld37/levelFile.c).
+ */
+#include <base/error.h>
+#include <ld37/levelFile.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) fprintf(stderr, __VA_ARGS__)
+
+/** Maximum number of {tile, type} pairs on a single map */
+#define MAX_TILETYPES 256
+
+/** Everything retrieved from the input map */
+struct stMapCtx {
+    int widthInTiles;
+    int heightInTiles;
+    int numTileTypes;
+    int32_t tileTypes[MAX_TILETYPES * 2];
+    int32_t *pTiles;
+};
+typedef struct stMapCtx mapCtx;
+
+/** Append a {tile, type} pair to the map */
+static int _addTileType(mapCtx *pMap, int tile, const char *pName
+        , size_t len) {
+    if (pMap->numTileTypes >= MAX_TILETYPES) {
+        LOG("Too many tile types\n");
+        return 1;
+    }
+    pMap->tileTypes[pMap->numTileTypes * 2] = tile;
+    if (resolveTileType(&pMap->tileTypes[pMap->numTileTypes * 2 + 1], pName
+            , len) != ERR_OK) {
+        LOG("Unknown tile type '%.*s'\n", (int)len, pName);
+        return 1;
+    }
+    pMap->numTileTypes++;
+
+    return 0;
+}
+
+/** Alloc the tiles after the map's dimensions were retrieved */
+static int _allocTiles(mapCtx *pMap) {
+    if (pMap->widthInTiles <= 0 || pMap->heightInTiles <= 0) {
+        LOG("Invalid map dimensions (%ix%i)\n", pMap->widthInTiles
+                , pMap->heightInTiles);
+        return 1;
+    }
+    pMap->pTiles = malloc(sizeof(int32_t) * pMap->widthInTiles
+            * pMap->heightInTiles);
+    if (!pMap->pTiles) {
+        LOG("Failed to alloc the tiles\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parse a GFraMe map, through the same parser used by the game
+ *
+ * @param  [out]pMap  The parsed map
+ * @param  [ in]pText The whole file, '\0'-terminated
+ */
+static int _parseGfm(mapCtx *pMap, char *pText) {
+    levelText text;
+    int i;
+
+    if (parseLevelText(&text, pText) != ERR_OK) {
+        LOG("Invalid .gfm map (only 'type' and 'map' tokens are supported)\n");
+        return 1;
+    }
+
+    pMap->widthInTiles = text.widthInTiles;
+    pMap->heightInTiles = text.heightInTiles;
+    if (_allocTiles(pMap) != 0) {
+        freeLevelText(&text);
+        return 1;
+    }
+    i = 0;
+    while (i < text.widthInTiles * text.heightInTiles) {
+        pMap->pTiles[i] = text.pTiles[i];
+        i++;
+    }
+    if (text.numTileTypes > MAX_TILETYPES) {
+        LOG("Too many tile types\n");
+        freeLevelText(&text);
+        return 1;
+    }
+    i = 0;
+    while (i < text.numTileTypes * 2) {
+        pMap->tileTypes[i] = text.pTileTypes[i];
+        i++;
+    }
+    pMap->numTileTypes = text.numTileTypes;
+    freeLevelText(&text);
+
+    return 0;
+}
+
+/**
+ * Retrieve the value of a XML attribute within a tag
+ *
+ * @param  [out]ppValue Start of the value (not '\0'-terminated)
+ * @param  [out]pLen    Length of the value
+ * @param  [ in]pTag    Start of the tag
+ * @param  [ in]pAttr   Attribute being searched (e.g., "width=\"")
+ * @return              0 on success
+ */
+static int _getAttr(char **ppValue, size_t *pLen, char *pTag
+        , const char *pAttr) {
+    char *pEnd, *pValue;
+
+    pEnd = strchr(pTag, '>');
+    pValue = strstr(pTag, pAttr);
+    if (!pEnd || !pValue || pValue > pEnd) {
+        return 1;
+    }
+    pValue += strlen(pAttr);
+    *ppValue = pValue;
+    *pLen = strcspn(pValue, "\"");
+
+    return 0;
+}
+
+/**
+ * Parse a Tiled map. Terrains are used as the tiles' types (only the first
+ * corner is checked) and the first layer must be CSV encoded.
+ *
+ * @param  [out]pMap  The parsed map
+ * @param  [ in]pText The whole file, '\0'-terminated
+ */
+static int _parseTmx(mapCtx *pMap, char *pText) {
+    char *pTerrains[MAX_TILETYPES];
+    size_t terrainLens[MAX_TILETYPES];
+    char *pCur, *pValue;
+    size_t len;
+    int firstGid, numTerrains, i;
+
+    pCur = strstr(pText, "<map ");
+    if (!pCur || _getAttr(&pValue, &len, pCur, " width=\"") != 0) {
+        LOG("Missing map's width\n");
+        return 1;
+    }
+    pMap->widthInTiles = atoi(pValue);
+    if (_getAttr(&pValue, &len, pCur, " height=\"") != 0) {
+        LOG("Missing map's height\n");
+        return 1;
+    }
+    pMap->heightInTiles = atoi(pValue);
+
+    firstGid = 1;
+    pCur = strstr(pText, "<tileset ");
+    if (pCur && _getAttr(&pValue, &len, pCur, " firstgid=\"") == 0) {
+        firstGid = atoi(pValue);
+    }
+
+    /* List every terrain (i.e., type) by its index */
+    numTerrains = 0;
+    pCur = strstr(pText, "<terrain ");
+    while (pCur && numTerrains < MAX_TILETYPES) {
+        if (_getAttr(&pTerrains[numTerrains], &terrainLens[numTerrains], pCur
+                , " name=\"") != 0) {
+            LOG("Terrain without a name\n");
+            return 1;
+        }
+        numTerrains++;
+        pCur = strstr(pCur + 1, "<terrain ");
+    }
+
+    /* Assign a type to every tile with a terrain */
+    pCur = strstr(pText, "<tile ");
+    while (pCur) {
+        int tile, terrain;
+
+        if (_getAttr(&pValue, &len, pCur, " id=\"") != 0) {
+            LOG("Tile without an id\n");
+            return 1;
+        }
+        tile = atoi(pValue);
+        if (_getAttr(&pValue, &len, pCur, " terrain=\"") == 0) {
+            terrain = atoi(pValue);
+            if (terrain < 0 || terrain >= numTerrains) {
+                LOG("Invalid terrain for tile %i\n", tile);
+                return 1;
+            }
+            if (_addTileType(pMap, tile, pTerrains[terrain]
+                    , terrainLens[terrain]) != 0) {
+                return 1;
+            }
+        }
+        pCur = strstr(pCur + 1, "<tile ");
+    }
+
+    pCur = strstr(pText, "<data ");
+    if (!pCur || _getAttr(&pValue, &len, pCur, " encoding=\"") != 0
+            || len != 3 || strncmp(pValue, "csv", 3) != 0) {
+        LOG("Only CSV layers are supported\n");
+        return 1;
+    }
+    pCur = strchr(pCur, '>') + 1;
+    if (_allocTiles(pMap) != 0) {
+        return 1;
+    }
+
+    /* Convert from global IDs (where 0 is an empty tile) to tiles */
+    i = 0;
+    while (i < pMap->widthInTiles * pMap->heightInTiles) {
+        char *pEnd;
+        long gid;
+
+        gid = strtol(pCur, &pEnd, 10);
+        if (pEnd == pCur) {
+            LOG("Layer ended after %i tiles\n", i);
+            return 1;
+        }
+        pMap->pTiles[i] = (gid == 0) ? -1 : (int32_t)gid - firstGid;
+        pCur = pEnd + strspn(pEnd, ", \t\r\n");
+        i++;
+    }
+
+    return 0;
+}
+
+/** Read a whole file into a '\0'-terminated buffer */
+static char* _readFile(const char *pPath) {
+    FILE *pFp;
+    char *pText;
+    long size;
+
+    pFp = fopen(pPath, "rb");
+    if (!pFp) {
+        LOG("Failed to open '%s'\n", pPath);
+        return 0;
+    }
+
+    pText = 0;
+    if (fseek(pFp, 0, SEEK_END) == 0 && (size = ftell(pFp)) >= 0
+            && fseek(pFp, 0, SEEK_SET) == 0) {
+        pText = malloc(size + 1);
+        if (pText && fread(pText, 1, size, pFp) == (size_t)size) {
+            pText[size] = '\0';
+        }
+        else {
+            free(pText);
+            pText = 0;
+        }
+    }
+    fclose(pFp);
+
+    if (!pText) {
+        LOG("Failed to read '%s'\n", pPath);
+    }
+    return pText;
+}
+
+/** Write the map in the binary format */
+static int _writeMap(mapCtx *pMap, const char *pPath) {
+    levelFileHeader header;
+    levelTiles tiles;
+    uint32_t *pOffsets;
+    size_t chunkBytes, offset;
+    FILE *pFp;
+    int i, numChunks, ok;
+
+    /* Split the tiles into chunks, stored on the narrowest possible type */
+    if (initLevelTiles(&tiles, pMap->pTiles, pMap->widthInTiles
+            , pMap->heightInTiles) != ERR_OK) {
+        LOG("Failed to split the map into chunks\n");
+        return 1;
+    }
+    numChunks = tiles.widthInChunks * tiles.heightInChunks;
+    chunkBytes = (size_t)tiles.bytesPerTile * LEVEL_CHUNK_TILES;
+
+    memset(&header, 0x0, sizeof(levelFileHeader));
+    header.magic = LEVEL_FILE_MAGIC;
+    header.version = LEVEL_FILE_VERSION;
+    header.widthInTiles = pMap->widthInTiles;
+    header.heightInTiles = pMap->heightInTiles;
+    header.numTileTypes = pMap->numTileTypes;
+    header.bytesPerTile = tiles.bytesPerTile;
+
+    /* Non-empty chunks are stored in order, right after the offsets */
+    pOffsets = malloc(sizeof(uint32_t) * numChunks);
+    if (!pOffsets) {
+        LOG("Failed to alloc the chunk offsets\n");
+        freeLevelTiles(&tiles);
+        return 1;
+    }
+    offset = sizeof(levelFileHeader) + sizeof(int32_t) * 2 * pMap->numTileTypes
+            + sizeof(uint32_t) * numChunks;
+    i = 0;
+    while (i < numChunks) {
+        if (tiles.ppChunks[i]) {
+            pOffsets[i] = (uint32_t)offset;
+            offset += chunkBytes;
+        }
+        else {
+            pOffsets[i] = 0;
+        }
+        i++;
+    }
+
+    ok = 0;
+    pFp = fopen(pPath, "wb");
+    if (!pFp) {
+        LOG("Failed to open '%s'\n", pPath);
+        goto __ret;
+    }
+    ok = fwrite(&header, sizeof(levelFileHeader), 1, pFp) == 1;
+    if (ok && pMap->numTileTypes > 0) {
+        ok = fwrite(pMap->tileTypes, sizeof(int32_t) * 2, pMap->numTileTypes
+                , pFp) == (size_t)pMap->numTileTypes;
+    }
+    ok = ok && fwrite(pOffsets, sizeof(uint32_t), numChunks, pFp)
+            == (size_t)numChunks;
+    if (ok && tiles.numChunks > 0) {
+        ok = fwrite(tiles.pBuffer, chunkBytes, tiles.numChunks, pFp)
+                == (size_t)tiles.numChunks;
+    }
+    ok = (fclose(pFp) == 0) && ok;
+
+    if (!ok) {
+        LOG("Failed to write '%s'\n", pPath);
+        remove(pPath);
+    }
+__ret:
+    free(pOffsets);
+    freeLevelTiles(&tiles);
+
+    return !ok;
+}
+
+int main(int argc, char *argv[]) {
+    mapCtx map;
+    char *pText;
+    size_t len;
+    int ret;
+
+    if (argc != 3) {
+        LOG("Usage: %s <input.gfm|input.tmx> <output.bin>\n", argv[0]);
+        return 1;
+    }
+
+    pText = _readFile(argv[1]);
+    if (!pText) {
+        return 1;
+    }
+
+    memset(&map, 0x0, sizeof(mapCtx));
+    len = strlen(argv[1]);
+    if (len > 4 && strcmp(argv[1] + len - 4, ".tmx") == 0) {
+        ret = _parseTmx(&map, pText);
+    }
+    else {
+        ret = _parseGfm(&map, pText);
+    }
+    if (ret == 0) {
+        ret = _writeMap(&map, argv[2]);
+    }
+
+    free(map.pTiles);
+    free(pText);
+    return ret;
+}